@@ -53,6 +53,7 @@ FLUIDSYNTH_API fluid_settings_t* fluid_synth_get_settings(fluid_synth_t* synth);
 /* MIDI channel messages */
 
 FLUIDSYNTH_API int fluid_synth_noteon(fluid_synth_t* synth, int chan, int key, int vel);
+FLUIDSYNTH_API int fluid_synth_noteon_at(fluid_synth_t* synth, int frame_offset, int chan, int key, int vel);
 FLUIDSYNTH_API int fluid_synth_noteoff(fluid_synth_t* synth, int chan, int key);
 FLUIDSYNTH_API int fluid_synth_cc(fluid_synth_t* synth, int chan, int ctrl, int val);
 FLUIDSYNTH_API int fluid_synth_get_cc(fluid_synth_t* synth, int chan, int ctrl, int* pval);
@@ -109,6 +110,18 @@ FLUIDSYNTH_API int fluid_synth_stop(fluid_synth_t* synth, unsigned int id);
 FLUIDSYNTH_API 
 int fluid_synth_sfload(fluid_synth_t* synth, const char* filename, int reset_presets);
 FLUIDSYNTH_API int fluid_synth_sfreload(fluid_synth_t* synth, unsigned int id);
+
+/**
+ * Callback function type used with fluid_synth_sfload_async().
+ * @param data User defined data pointer
+ * @param filename The file that was loaded
+ * @param sfont_id ID of the loaded SoundFont, #FLUID_FAILED if loading failed
+ * @since 2.0.0
+ */
+typedef void (*fluid_sfload_callback_t)(void* data, const char* filename, int sfont_id);
+
+FLUIDSYNTH_API int fluid_synth_sfload_async(fluid_synth_t* synth, const char* filename, int reset_presets,
+                                            fluid_sfload_callback_t callback, void* data);
 FLUIDSYNTH_API int fluid_synth_sfunload(fluid_synth_t* synth, unsigned int id, int reset_presets);
 FLUIDSYNTH_API int fluid_synth_add_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont);
 FLUIDSYNTH_API void fluid_synth_remove_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont);
@@ -191,6 +204,7 @@ FLUIDSYNTH_API float fluid_synth_get_gain(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_set_polyphony(fluid_synth_t* synth, int polyphony);
 FLUIDSYNTH_API int fluid_synth_get_polyphony(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_get_active_voice_count(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_voice_memory(fluid_synth_t* synth, int* voices, int* bytes);
 FLUIDSYNTH_API int fluid_synth_get_internal_bufsize(fluid_synth_t* synth);
 
 FLUIDSYNTH_API 
@@ -241,6 +255,10 @@ FLUIDSYNTH_API int fluid_synth_tuning_dump(fluid_synth_t* synth, int bank, int p
 /* Misc */
 
 FLUIDSYNTH_API double fluid_synth_get_cpu_load(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_get_cpu_governor_stats(fluid_synth_t* synth, int* voice_limit,
+                                                      int* overloads, int* kills);
+FLUIDSYNTH_API int fluid_synth_get_coalescing_stats(fluid_synth_t* synth, int* updates,
+                                                    int* collapsed);
 FLUIDSYNTH_API const char* fluid_synth_error(fluid_synth_t* synth);
 
 
@@ -278,6 +296,9 @@ FLUIDSYNTH_API int fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
 FLUIDSYNTH_API int fluid_synth_process(fluid_synth_t* synth, int len,
 				     int nin, float** in, 
 				     int nout, float** out);
+FLUIDSYNTH_API int fluid_synth_render_direct(fluid_synth_t* synth, int blocks,
+				     const float*** left, const float*** right,
+				     const float*** fx_left, const float*** fx_right);
 
 
 /* Synthesizer's interface to handle SoundFont loaders */
@@ -81,6 +81,8 @@ struct _fluid_jack_midi_driver_t
   fluid_jack_client_t *client_ref;
   int midi_port_count;
   jack_port_t **midi_port; // array of midi port handles
+  void **midi_buffer; // per port event buffer of the current period
+  jack_nframes_t *next_event; // per port index of the next event to process
   fluid_midi_parser_t *parser;
 };
 
@@ -266,9 +268,18 @@ fluid_jack_client_register_ports (void *driver, int isaudio, jack_client_t *clie
     
     fluid_settings_getint(settings, "synth.midi-channels", &midi_channels);
     ports = midi_channels / 16;
-    if((dev->midi_port = FLUID_ARRAY(jack_port_t*, ports)) == NULL)
+    dev->midi_port = FLUID_ARRAY(jack_port_t*, ports);
+    dev->midi_buffer = FLUID_ARRAY(void*, ports);
+    dev->next_event = FLUID_ARRAY(jack_nframes_t, ports);
+    if(dev->midi_port == NULL || dev->midi_buffer == NULL || dev->next_event == NULL)
     {
         FLUID_LOG (FLUID_ERR, "Out of memory");
+        FLUID_FREE(dev->midi_port);
+        FLUID_FREE(dev->midi_buffer);
+        FLUID_FREE(dev->next_event);
+        dev->midi_port = NULL;
+        dev->midi_buffer = NULL;
+        dev->next_event = NULL;
         return FLUID_FAILED;
     }
     
@@ -524,6 +535,100 @@ delete_fluid_jack_audio_driver(fluid_audio_driver_t* p)
   FLUID_FREE(dev);
 }
 
+/*
+ * Get the earliest MIDI event of the current period, not processed yet,
+ * merging the events of all ports.
+ * @return Index of the port the event was received on, -1 if none is left
+ */
+static int
+fluid_jack_midi_next_event (fluid_jack_midi_driver_t *dev, jack_midi_event_t *event)
+{
+  jack_midi_event_t candidate;
+  int i, port = -1;
+
+  for (i = 0; i < dev->midi_port_count; i++)
+  {
+    if (dev->next_event[i] >= jack_midi_get_event_count (dev->midi_buffer[i]))
+      continue;
+
+    if (jack_midi_event_get (&candidate, dev->midi_buffer[i], dev->next_event[i]) != 0)
+    {
+      dev->next_event[i]++;     /* skip unreadable event */
+      continue;
+    }
+
+    if (port < 0 || candidate.time < event->time)
+    {
+      *event = candidate;
+      port = i;
+    }
+  }
+
+  if (port >= 0)
+    dev->next_event[port]++;
+
+  return port;
+}
+
+/*
+ * Send the bytes of a JACK MIDI event through the parser to the MIDI handler.
+ * Note-ons are tagged with frame_offset, the frame within the next block
+ * synthesized at which they start.
+ */
+static void
+fluid_jack_midi_handle_event (fluid_jack_midi_driver_t *dev, jack_midi_event_t *event, int port,
+                              int frame_offset)
+{
+  fluid_midi_event_t *evt;
+  size_t u;
+
+  /* let the parser convert the data into events */
+  for (u = 0; u < event->size; u++)
+  {
+    evt = fluid_midi_parser_parse (dev->parser, event->buffer[u]);
+
+    /* send the event to the next link in the chain */
+    if (evt != NULL)
+    {
+      fluid_midi_event_set_channel(evt, fluid_midi_event_get_channel(evt) + port * 16);
+      evt->frame_offset = frame_offset;
+      dev->driver.handler (dev->driver.data, evt);
+    }
+  }
+}
+
+/*
+ * Synthesize len frames of the current period, starting at frame offset,
+ * to the output buffers fetched by fluid_jack_driver_process().
+ */
+static void
+fluid_jack_driver_render (fluid_jack_audio_driver_t *dev, float *left, float *right,
+                          int offset, int len)
+{
+  int i;
+
+  if (len <= 0)
+    return;
+
+  if (dev->num_output_ports == 1 && dev->num_fx_ports == 0) /* i.e. audio.jack.multi=no */
+  {
+    fluid_synth_write_float (dev->data, len, left, offset, 1, right, offset, 1);
+    return;
+  }
+
+  fluid_synth_nwrite_float (dev->data, len,
+                            dev->output_bufs,
+                            dev->output_bufs + dev->num_output_ports,
+                            dev->fx_bufs,
+                            dev->fx_bufs + dev->num_fx_ports);
+
+  /* advance the buffers for the next chunk of the period */
+  for (i = 0; i < 2 * dev->num_output_ports; i++)
+    dev->output_bufs[i] += len;
+  for (i = 0; i < 2 * dev->num_fx_ports; i++)
+    dev->fx_bufs[i] += len;
+}
+
 /* Process function for audio and MIDI Jack drivers */
 int
 fluid_jack_driver_process (jack_nframes_t nframes, void *arg)
@@ -531,47 +636,66 @@ fluid_jack_driver_process (jack_nframes_t nframes, void *arg)
   fluid_jack_client_t *client = (fluid_jack_client_t *)arg;
   fluid_jack_audio_driver_t *audio_driver;
   fluid_jack_midi_driver_t *midi_driver;
-  float *left, *right;
-  int i, k;
+  fluid_synth_t *synth = NULL;
+  float *left = NULL, *right = NULL;
+  int i, k, port;
+  int rendered = 0;
 
   jack_midi_event_t midi_event;
-  fluid_midi_event_t *evt;
-  void *midi_buffer;
-  jack_nframes_t event_count;
-  jack_nframes_t event_index;
-  unsigned int u;
 
-  /* Process MIDI events first, so that they take effect before audio synthesis */
   midi_driver = fluid_atomic_pointer_get (&client->midi_driver);
+  audio_driver = fluid_atomic_pointer_get (&client->audio_driver);
+
+  if (audio_driver && audio_driver->callback == NULL)
+  {
+    /* We render the synth ourselves, so MIDI events can be interleaved with synthesis */
+    synth = audio_driver->data;
+
+    if (audio_driver->num_output_ports == 1 && audio_driver->num_fx_ports == 0) /* i.e. audio.jack.multi=no */
+    {
+      left = (float*) jack_port_get_buffer (audio_driver->output_ports[0], nframes);
+      right = (float*) jack_port_get_buffer (audio_driver->output_ports[1], nframes);
+    }
+    else
+    {
+      for (i = 0, k = audio_driver->num_output_ports; i < audio_driver->num_output_ports; i++, k++) {
+        audio_driver->output_bufs[i] = (float *)jack_port_get_buffer (audio_driver->output_ports[2*i], nframes);
+        audio_driver->output_bufs[k] = (float *)jack_port_get_buffer (audio_driver->output_ports[2*i+1], nframes);
+      }
+      for (i = 0, k = audio_driver->num_fx_ports; i < audio_driver->num_fx_ports; i++, k++) {
+        audio_driver->fx_bufs[i] = (float*) jack_port_get_buffer(audio_driver->fx_ports[2*i], nframes);
+        audio_driver->fx_bufs[k] = (float*) jack_port_get_buffer(audio_driver->fx_ports[2*i+1], nframes);
+      }
+    }
+  }
 
   if (midi_driver)
   {
     for (i = 0; i < midi_driver->midi_port_count; i++)
     {
-        midi_buffer = jack_port_get_buffer (midi_driver->midi_port[i], 0);
-        event_count = jack_midi_get_event_count (midi_buffer);
+        midi_driver->midi_buffer[i] = jack_port_get_buffer (midi_driver->midi_port[i], 0);
+        midi_driver->next_event[i] = 0;
+    }
 
-        for (event_index = 0; event_index < event_count; event_index++)
+    while ((port = fluid_jack_midi_next_event (midi_driver, &midi_event)) >= 0)
+    {
+        int frame_offset = 0;
+
+        if (synth != NULL && (int)midi_event.time > rendered)
         {
-            jack_midi_event_get (&midi_event, midi_buffer, event_index);
-
-            /* let the parser convert the data into events */
-            for (u = 0; u < midi_event.size; u++)
-            {
-                evt = fluid_midi_parser_parse (midi_driver->parser, midi_event.buffer[u]);
-
-                /* send the event to the next link in the chain */
-                if (evt != NULL)
-                {
-                    fluid_midi_event_set_channel(evt, fluid_midi_event_get_channel(evt) + i * 16);
-                    midi_driver->driver.handler (midi_driver->driver.data, evt);
-                }
-            }
+            /* Synthesize up to the last block boundary before the event and
+             * start the event's notes at their exact frame within the next block. */
+            int len = fluid_synth_get_aligned_frames (synth, midi_event.time - rendered);
+
+            fluid_jack_driver_render (audio_driver, left, right, rendered, len);
+            rendered += len;
+            frame_offset = midi_event.time - rendered;
         }
+
+        fluid_jack_midi_handle_event (midi_driver, &midi_event, port, frame_offset);
     }
   }
 
-  audio_driver = fluid_atomic_pointer_get (&client->audio_driver);
   if (!audio_driver) return 0;
 
   if (audio_driver->callback != NULL)
@@ -583,31 +707,8 @@ fluid_jack_driver_process (jack_nframes_t nframes, void *arg)
                                      2 * audio_driver->num_output_ports,
                                      audio_driver->output_bufs);
   }
-  else if (audio_driver->num_output_ports == 1 && audio_driver->num_fx_ports == 0) /* i.e. audio.jack.multi=no */
-  {
-    left = (float*) jack_port_get_buffer (audio_driver->output_ports[0], nframes);
-    right = (float*) jack_port_get_buffer (audio_driver->output_ports[1], nframes);
-
-    fluid_synth_write_float (audio_driver->data, nframes, left, 0, 1, right, 0, 1);
-  }
-  else
-  {
-    for (i = 0, k = audio_driver->num_output_ports; i < audio_driver->num_output_ports; i++, k++) {
-      audio_driver->output_bufs[i] = (float *)jack_port_get_buffer (audio_driver->output_ports[2*i], nframes);
-      audio_driver->output_bufs[k] = (float *)jack_port_get_buffer (audio_driver->output_ports[2*i+1], nframes);
-    }
-    for (i = 0, k = audio_driver->num_fx_ports; i < audio_driver->num_fx_ports; i++, k++) {
-      audio_driver->fx_bufs[i] = (float*) jack_port_get_buffer(audio_driver->fx_ports[2*i], nframes);
-      audio_driver->fx_bufs[k] = (float*) jack_port_get_buffer(audio_driver->fx_ports[2*i+1], nframes);
-    }
 
-    fluid_synth_nwrite_float (audio_driver->data,
-                              nframes,
-                              audio_driver->output_bufs,
-                              audio_driver->output_bufs + audio_driver->num_output_ports,
-                              audio_driver->fx_bufs,
-                              audio_driver->fx_bufs + audio_driver->num_fx_ports);
-  }
+  fluid_jack_driver_render (audio_driver, left, right, rendered, nframes - rendered);
 
   return 0;
 }
@@ -699,6 +800,8 @@ delete_fluid_jack_midi_driver(fluid_midi_driver_t *p)
 
   delete_fluid_midi_parser (dev->parser);
   FLUID_FREE(dev->midi_port);
+  FLUID_FREE(dev->midi_buffer);
+  FLUID_FREE(dev->next_event);
   FLUID_FREE (dev);
 }
 
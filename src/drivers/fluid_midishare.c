@@ -223,6 +223,8 @@ static void fluid_midishare_midi_driver_receive(short ref)
   MidiEvPtr e;
   int count, i;
 
+  new_event.frame_offset = 0;
+
   while ((e = MidiGetEv (ref)))
   {
     switch (EvType (e))
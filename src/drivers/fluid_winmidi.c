@@ -302,6 +302,7 @@ fluid_winmidi_callback(HMIDIIN hmi, UINT wMsg, DWORD_PTR dwInstance,
   case MIM_DATA:
     event.type = msg_type(msg_param);
     event.channel = msg_chan(msg_param);
+    event.frame_offset = 0;
 
     if (event.type != PITCH_BEND) {
       event.param1 = msg_p1(msg_param);
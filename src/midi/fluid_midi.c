@@ -815,6 +815,7 @@ new_fluid_midi_event ()
         return NULL;
     }
     evt->dtime = 0;
+    evt->frame_offset = 0;
     evt->type = 0;
     evt->channel = 0;
     evt->param1 = 0;
@@ -1900,6 +1901,7 @@ new_fluid_midi_parser ()
         return NULL;
     }
     parser->status = 0; /* As long as the status is 0, the parser won't do anything -> no need to initialize all the fields. */
+    parser->event.frame_offset = 0;
     return parser;
 }
 
@@ -227,6 +227,7 @@ struct _fluid_midi_event_t {
   fluid_midi_event_t* next; /* Link to next event */
   void *paramptr;           /* Pointer parameter (for SYSEX data), size is stored to param1, param2 indicates if pointer should be freed (dynamic if TRUE) */
   unsigned int dtime;       /* Delay (ticks) between this and previous event. midi tracks. */
+  unsigned int frame_offset; /* Frame offset of a note-on within the next synthesized block, see fluid_synth_noteon_at() */
   unsigned int param1;      /* First parameter */
   unsigned int param2;      /* Second parameter */
   unsigned char type;       /* MIDI event type */
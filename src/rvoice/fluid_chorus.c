@@ -332,13 +332,14 @@ fluid_chorus_set(fluid_chorus_t* chorus, int set, int nr, float level,
 
 
 void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
-			    fluid_real_t *left_out, fluid_real_t *right_out)
+			    fluid_real_t *left_out, fluid_real_t *right_out,
+			    int count)
 {
   int sample_index;
   int i;
   fluid_real_t d_in, d_out;
 
-  for (sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++) {
+  for (sample_index = 0; sample_index < count; sample_index++) {
 
     d_in = in[sample_index];
     d_out = 0.0f;
@@ -400,13 +401,14 @@ void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
 
 /* Duplication of code ... (replaces sample data instead of mixing) */
 void fluid_chorus_processreplace(fluid_chorus_t* chorus, fluid_real_t *in,
-				fluid_real_t *left_out, fluid_real_t *right_out)
+				fluid_real_t *left_out, fluid_real_t *right_out,
+				int count)
 {
   int sample_index;
   int i;
   fluid_real_t d_in, d_out;
 
-  for (sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++) {
+  for (sample_index = 0; sample_index < count; sample_index++) {
 
     d_in = in[sample_index];
     d_out = 0.0f;
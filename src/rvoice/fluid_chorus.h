@@ -56,9 +56,11 @@ void fluid_chorus_set(fluid_chorus_t* chorus, int set, int nr, float level,
                       float speed, float depth_ms, int type);
 
 void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
-			    fluid_real_t *left_out, fluid_real_t *right_out);
+			    fluid_real_t *left_out, fluid_real_t *right_out,
+			    int count);
 void fluid_chorus_processreplace(fluid_chorus_t* chorus, fluid_real_t *in,
-				fluid_real_t *left_out, fluid_real_t *right_out);
+				fluid_real_t *left_out, fluid_real_t *right_out,
+				int count);
 
 
 
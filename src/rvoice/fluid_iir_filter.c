@@ -327,7 +327,7 @@ fluid_iir_filter_calculate_coefficients(fluid_iir_filter_t* iir_filter,
 
     /* The filter frequency is changed.  Calculate an increment
      * factor, so that the new setting is reached after one buffer
-     * length. x_incr is added to the current value FLUID_BUFSIZE
+     * length. x_incr is added to the current value transition_samples
      * times. The length is arbitrarily chosen. Longer than one
      * buffer will sacrifice some performance, though.  Note: If
      * the filter is still too 'grainy', then increase this number
@@ -352,7 +352,8 @@ fluid_iir_filter_calculate_coefficients(fluid_iir_filter_t* iir_filter,
 
 void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter, 
                            fluid_real_t output_rate, 
-                           fluid_real_t fres_mod)
+                           fluid_real_t fres_mod,
+                           int transition_samples)
 {
   fluid_real_t fres;
 
@@ -387,7 +388,7 @@ void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter,
     * case, the filter is set directly, instead of smoothly fading
     * between old and new settings. */
     iir_filter->last_fres = fres;
-    fluid_iir_filter_calculate_coefficients(iir_filter, FLUID_BUFSIZE,  
+    fluid_iir_filter_calculate_coefficients(iir_filter, transition_samples,
                                             output_rate);
   }
 
@@ -40,7 +40,8 @@ void fluid_iir_filter_set_fres(fluid_iir_filter_t* iir_filter,
 
 void fluid_iir_filter_calc(fluid_iir_filter_t* iir_filter, 
                            fluid_real_t output_rate, 
-                           fluid_real_t fres_mod);
+                           fluid_real_t fres_mod,
+                           int transition_samples);
 
 /* We can't do information hiding here, as fluid_voice_t includes the struct
    without a pointer. */
@@ -358,12 +358,13 @@ fluid_revmodel_reset(fluid_revmodel_t* rev)
 
 void
 fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
-			     fluid_real_t *left_out, fluid_real_t *right_out)
+			     fluid_real_t *left_out, fluid_real_t *right_out,
+			     int count)
 {
   int i, k = 0;
   fluid_real_t outL, outR, input;
 
-  for (k = 0; k < FLUID_BUFSIZE; k++) {
+  for (k = 0; k < count; k++) {
 
     outL = outR = 0;
 
@@ -396,12 +397,13 @@ fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
 
 void
 fluid_revmodel_processmix(fluid_revmodel_t* rev, fluid_real_t *in,
-			 fluid_real_t *left_out, fluid_real_t *right_out)
+			 fluid_real_t *left_out, fluid_real_t *right_out,
+			 int count)
 {
   int i, k = 0;
   fluid_real_t outL, outR, input;
 
-  for (k = 0; k < FLUID_BUFSIZE; k++) {
+  for (k = 0; k < count; k++) {
 
     outL = outR = 0;
 
@@ -86,8 +86,8 @@ fluid_rvoice_calc_amp(fluid_rvoice_t* voice)
     }
   }
 
-  /* Volume increment to go from voice->amp to target_amp in FLUID_BUFSIZE steps */
-  voice->dsp.amp_incr = (target_amp - voice->dsp.amp) / FLUID_BUFSIZE;
+  /* Volume increment to go from voice->amp to target_amp in dsp_buf_count steps */
+  voice->dsp.amp_incr = (target_amp - voice->dsp.amp) / voice->dsp.dsp_buf_count;
 
   fluid_check_fpe ("voice_write amplitude calculation");
 
@@ -258,18 +258,23 @@ fluid_rvoice_check_sample_sanity(fluid_rvoice_t* voice)
  * Synthesize a voice to a buffer.
  *
  * @param voice rvoice to synthesize
- * @param dsp_buf Audio buffer to synthesize to (#FLUID_BUFSIZE in length)
+ * @param dsp_buf Audio buffer to synthesize to (voice->dsp.block_size in length)
  * @return Count of samples written to dsp_buf. (-1 means voice is currently 
- * quiet, 0 .. #FLUID_BUFSIZE-1 means voice finished.)
+ * quiet, 0 .. voice->dsp.block_size-1 means voice finished.)
  *
  * Panning, reverb and chorus are processed separately. The dsp interpolation
  * routine is in (fluid_rvoice_dsp.c).
+ *
+ * A voice with a start offset stays quiet for that many frames. If the offset
+ * ends within this block, only the remainder of the block is synthesized.
  */
 int
 fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
 {
   int ticks = voice->envlfo.ticks;
-  int count;
+  int count, offset = 0;
+  int interp_method, with_custom_filter = TRUE;
+  fluid_real_t amp;
 
   /******************* sample sanity check **********/
 
@@ -285,7 +290,21 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
     fluid_rvoice_noteoff(voice, 0);
   }
 
-  voice->envlfo.ticks += FLUID_BUFSIZE;
+  /******************* start offset *****************/
+
+  if (voice->dsp.start_offset > 0) {
+    if (voice->dsp.start_offset >= voice->dsp.block_size) {
+      voice->dsp.start_offset -= voice->dsp.block_size;
+      return -1;
+    }
+    offset = voice->dsp.start_offset;
+    voice->dsp.start_offset = 0;
+    FLUID_MEMSET(dsp_buf, 0, offset * sizeof(fluid_real_t));
+    dsp_buf += offset;
+  }
+  voice->dsp.dsp_buf_count = voice->dsp.block_size - offset;
+
+  voice->envlfo.ticks += voice->dsp.dsp_buf_count;
 
   /******************* vol env **********************/
 
@@ -361,12 +380,34 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
 
   /*********************** run the dsp chain ************************
    * The sample is mixed with the output buffer.
-   * The buffer has to be filled from 0 to FLUID_BUFSIZE-1.
+   * The buffer has to be filled from 0 to dsp_buf_count-1.
    * Depending on the position in the loop and the loop size, this
    * may require several runs. */
   voice->dsp.dsp_buf = dsp_buf; 
 
-  switch (voice->dsp.interp_method)
+  /* Dynamic quality: once the attack is over, voices that have become quiet
+   * (typically release tails) are synthesized more cheaply. The loudest
+   * amplitude of this block is compared against the thresholds. */
+  interp_method = voice->dsp.interp_method;
+  if (voice->dsp.quality_linear_amp > 0.0f || voice->dsp.quality_none_amp > 0.0f) {
+    if (fluid_adsr_env_get_section(&voice->envlfo.volenv) > FLUID_VOICE_ENVATTACK) {
+      amp = voice->dsp.amp;
+      if (voice->dsp.amp_incr > 0.0f)
+        amp += voice->dsp.amp_incr * voice->dsp.dsp_buf_count;
+      amp *= voice->dsp.synth_gain;
+
+      if (amp < voice->dsp.quality_none_amp) {
+        interp_method = FLUID_INTERP_NONE;
+        with_custom_filter = FALSE;
+      }
+      else if (amp < voice->dsp.quality_linear_amp
+               && interp_method > FLUID_INTERP_LINEAR) {
+        interp_method = FLUID_INTERP_LINEAR;
+      }
+    }
+  }
+
+  switch (interp_method)
   {
     case FLUID_INTERP_NONE:
       count = fluid_rvoice_dsp_interpolate_none (&voice->dsp);
@@ -390,15 +431,19 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
   
   fluid_iir_filter_calc(&voice->resonant_filter, voice->dsp.output_rate,
   		        fluid_lfo_get_val(&voice->envlfo.modlfo) * voice->envlfo.modlfo_to_fc +
- 		        fluid_adsr_env_get_val(&voice->envlfo.modenv) * voice->envlfo.modenv_to_fc);
+ 		        fluid_adsr_env_get_val(&voice->envlfo.modenv) * voice->envlfo.modenv_to_fc,
+ 		        voice->dsp.block_size);
 
   fluid_iir_filter_apply(&voice->resonant_filter, dsp_buf, count);
 
   /* additional custom filter - only uses the fixed modulator, no lfos... */
-  fluid_iir_filter_calc(&voice->resonant_custom_filter, voice->dsp.output_rate, 0);
-  fluid_iir_filter_apply(&voice->resonant_custom_filter, dsp_buf, count);
+  if (with_custom_filter) {
+    fluid_iir_filter_calc(&voice->resonant_custom_filter, voice->dsp.output_rate, 0,
+                          voice->dsp.block_size);
+    fluid_iir_filter_apply(&voice->resonant_custom_filter, dsp_buf, count);
+  }
   
-  return count;
+  return offset + count;
 }
 
 
@@ -416,7 +461,7 @@ get_dest_buf(fluid_rvoice_buffers_t* buffers, int index,
  *
  * @param buffers Destination buffer(s)
  * @param dsp_buf Mono sample source
- * @param samplecount Number of samples to process (no FLUID_BUFSIZE restriction)
+ * @param samplecount Number of samples to process (no block size restriction)
  * @param dest_bufs Array of buffers to mixdown to
  * @param dest_bufcount Length of dest_bufs
  */
@@ -500,6 +545,7 @@ fluid_rvoice_reset(fluid_rvoice_t* voice)
   voice->dsp.has_looped = 0;
   voice->envlfo.ticks = 0;
   voice->envlfo.noteoff_ticks = 0;
+  voice->dsp.start_offset = 0;
   voice->dsp.amp = 0.0f; /* The last value of the volume envelope, used to
                             calculate the volume increment during
                             processing */
@@ -744,6 +790,16 @@ fluid_rvoice_set_synth_gain(fluid_rvoice_t* voice, fluid_real_t value)
   voice->dsp.check_sample_sanity_flag |= FLUID_SAMPLESANITY_CHECK;
 }
 
+/**
+ * Delay the start of a voice which has not been rendered yet.
+ * @param value Number of frames to stay silent, counted from the next block
+ */
+void 
+fluid_rvoice_set_start_offset(fluid_rvoice_t* voice, int value)
+{
+  voice->dsp.start_offset = value;
+}
+
 void 
 fluid_rvoice_set_start(fluid_rvoice_t* voice, int value)
 {
@@ -105,6 +105,7 @@ struct _fluid_rvoice_dsp_t
 	fluid_real_t pitch;              /* the pitch in midicents */
 	fluid_real_t root_pitch_hz;
 	fluid_real_t output_rate;
+	int block_size;                  /* samples synthesized per fluid_rvoice_write() call */
 
 	/* Stuff needed for amplitude calculations */
 
@@ -118,16 +119,24 @@ struct _fluid_rvoice_dsp_t
 	fluid_real_t amplitude_that_reaches_noise_floor_loop;
 	fluid_real_t synth_gain; 	/* master gain */
 
+	/* Stuff needed for dynamic quality, set by the mixer */
+
+	fluid_real_t quality_linear_amp; /* below this output amplitude, interpolate linearly (0: disabled) */
+	fluid_real_t quality_none_amp;   /* below this output amplitude, don't interpolate
+					  * and skip the custom filter (0: disabled) */
+
 
 	/* Dynamic input to the interpolator below */
 
 	fluid_real_t *dsp_buf;		/* buffer to store interpolated sample data to */
+	int dsp_buf_count;		/* number of samples to store to dsp_buf */
+	int start_offset;		/* frames to stay silent before the voice starts sounding */
 
 	fluid_real_t amp;                /* current linear amplitude */
-	fluid_real_t amp_incr;		/* amplitude increment value for the next FLUID_BUFSIZE samples */
+	fluid_real_t amp_incr;		/* amplitude increment value for the next dsp_buf_count samples */
 
 	fluid_phase_t phase;             /* the phase (current sample offset) of the sample wave */
-	fluid_real_t phase_incr;	/* the phase increment for the next FLUID_BUFSIZE samples */
+	fluid_real_t phase_incr;	/* the phase increment for the next dsp_buf_count samples */
 	int is_looping;
 
 };
@@ -159,6 +168,10 @@ struct _fluid_rvoice_t
 	fluid_iir_filter_t resonant_filter; /* IIR resonant dsp filter */
 	fluid_iir_filter_t resonant_custom_filter; /* optional custom/general-purpose IIR resonant filter */
 	fluid_rvoice_buffers_t buffers;
+
+	/* bookkeeping, so that a finished rvoice is found in constant time */
+	fluid_voice_t* voice;                /* voice owning this rvoice, set by the voice */
+	int mixer_index;                     /* index in the mixer's active rvoices, -1 if none */
 };
 
 
@@ -198,6 +211,7 @@ void fluid_rvoice_set_loopstart(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_loopend(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_sample(fluid_rvoice_t* voice, fluid_sample_t* value);
 void fluid_rvoice_set_samplemode(fluid_rvoice_t* voice, enum fluid_loop value);
+void fluid_rvoice_set_start_offset(fluid_rvoice_t* voice, int value);
 
 /* defined in fluid_rvoice_dsp.c */
 
@@ -42,7 +42,7 @@
  *
  * A couple of variables are used internally, their results are discarded:
  * - dsp_i: Index through the output buffer
- * - dsp_buf: Output buffer of floating point values (FLUID_BUFSIZE in length)
+ * - dsp_buf: Output buffer of floating point values (dsp_buf_count in length)
  */
 
 /* Interpolation (find a value between two samples of the original waveform) */
@@ -139,6 +139,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
   fluid_real_t *dsp_buf = voice->dsp_buf;
   fluid_real_t dsp_amp = voice->amp;
   fluid_real_t dsp_amp_incr = voice->amp_incr;
+  unsigned int dsp_buf_count = voice->dsp_buf_count;
   unsigned int dsp_i = 0;
   unsigned int dsp_phase_index;
   unsigned int end_index;
@@ -157,7 +158,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
     dsp_phase_index = fluid_phase_index_round (dsp_phase);	/* round to nearest point */
 
     /* interpolate sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    for ( ; dsp_i < dsp_buf_count && dsp_phase_index <= end_index; dsp_i++)
     {
       dsp_buf[dsp_i] = dsp_amp * fluid_rvoice_get_float_sample(dsp_data, dsp_data24, dsp_phase_index);
 
@@ -178,7 +179,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
   }
 
   voice->phase = dsp_phase;
@@ -188,7 +189,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
 }
 
 /* Straight line interpolation.
- * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * Returns number of samples processed (usually dsp_buf_count but could be
  * smaller if end of sample occurs).
  */
 int
@@ -201,6 +202,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
   fluid_real_t *dsp_buf = voice->dsp_buf;
   fluid_real_t dsp_amp = voice->amp;
   fluid_real_t dsp_amp_incr = voice->amp_incr;
+  unsigned int dsp_buf_count = voice->dsp_buf_count;
   unsigned int dsp_i = 0;
   unsigned int dsp_phase_index;
   unsigned int end_index;
@@ -226,7 +228,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
     dsp_phase_index = fluid_phase_index (dsp_phase);
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    for ( ; dsp_i < dsp_buf_count && dsp_phase_index <= end_index; dsp_i++)
     {
       coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_rvoice_get_float_sample(dsp_data, dsp_data24, dsp_phase_index)
@@ -239,12 +241,12 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index++;	/* we're now interpolating the last point */
 
     /* interpolate within last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_rvoice_get_float_sample(dsp_data, dsp_data24, dsp_phase_index)
@@ -266,7 +268,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index--;	/* set end back to second to last sample point */
   }
@@ -278,7 +280,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
 }
 
 /* 4th order (cubic) interpolation.
- * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * Returns number of samples processed (usually dsp_buf_count but could be
  * smaller if end of sample occurs).
  */
 int
@@ -291,6 +293,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
   fluid_real_t *dsp_buf = voice->dsp_buf;
   fluid_real_t dsp_amp = voice->amp;
   fluid_real_t dsp_amp_incr = voice->amp_incr;
+  unsigned int dsp_buf_count = voice->dsp_buf_count;
   unsigned int dsp_i = 0;
   unsigned int dsp_phase_index;
   unsigned int start_index, end_index;
@@ -335,7 +338,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     dsp_phase_index = fluid_phase_index (dsp_phase);
 
     /* interpolate first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for ( ; dsp_phase_index == start_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp *
@@ -351,7 +354,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     }
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    for ( ; dsp_i < dsp_buf_count && dsp_phase_index <= end_index; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp *
@@ -367,12 +370,12 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index++;	/* we're now interpolating the 2nd to last point */
 
     /* interpolate within 2nd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp *
@@ -390,7 +393,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     end_index++;	/* we're now interpolating the last point */
 
     /* interpolate within the last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp *
@@ -421,7 +424,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index -= 2;	/* set end back to third to last sample point */
   }
@@ -433,7 +436,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
 }
 
 /* 7th order interpolation.
- * Returns number of samples processed (usually FLUID_BUFSIZE but could be
+ * Returns number of samples processed (usually dsp_buf_count but could be
  * smaller if end of sample occurs).
  */
 int
@@ -446,6 +449,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
   fluid_real_t *dsp_buf = voice->dsp_buf;
   fluid_real_t dsp_amp = voice->amp;
   fluid_real_t dsp_amp_incr = voice->amp_incr;
+  unsigned int dsp_buf_count = voice->dsp_buf_count;
   unsigned int dsp_i = 0;
   unsigned int dsp_phase_index;
   unsigned int start_index, end_index;
@@ -500,7 +504,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     dsp_phase_index = fluid_phase_index (dsp_phase);
 
     /* interpolate first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for ( ; dsp_phase_index == start_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -522,7 +526,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     start_index++;
 
     /* interpolate 2nd to first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for ( ; dsp_phase_index == start_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -544,7 +548,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     start_index++;
 
     /* interpolate 3rd to first sample point (start or loop start) if needed */
-    for ( ; dsp_phase_index == start_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for ( ; dsp_phase_index == start_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -567,7 +571,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
 
 
     /* interpolate the sequence of sample points */
-    for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
+    for ( ; dsp_i < dsp_buf_count && dsp_phase_index <= end_index; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -587,12 +591,12 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if buffer filled */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index++;	/* we're now interpolating the 3rd to last point */
 
     /* interpolate within 3rd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -614,7 +618,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     end_index++;	/* we're now interpolating the 2nd to last point */
 
     /* interpolate within 2nd to last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -636,7 +640,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     end_index++;	/* we're now interpolating the last point */
 
     /* interpolate within last point */
-    for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
+    for (; dsp_phase_index <= end_index && dsp_i < dsp_buf_count; dsp_i++)
     {
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
@@ -673,7 +677,7 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
     }
 
     /* break out if filled buffer */
-    if (dsp_i >= FLUID_BUFSIZE) break;
+    if (dsp_i >= dsp_buf_count) break;
 
     end_index -= 3;	/* set end back to 4th to last sample point */
   }
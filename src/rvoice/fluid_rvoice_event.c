@@ -138,10 +138,12 @@ fluid_rvoice_event_dispatch(fluid_rvoice_event_t* event)
   EVENTFUNC_I1(fluid_rvoice_set_loopstart, fluid_rvoice_t*);
   EVENTFUNC_I1(fluid_rvoice_set_loopend, fluid_rvoice_t*);
   EVENTFUNC_I1(fluid_rvoice_set_samplemode, fluid_rvoice_t*);
+  EVENTFUNC_I1(fluid_rvoice_set_start_offset, fluid_rvoice_t*);
   EVENTFUNC_PTR(fluid_rvoice_set_sample, fluid_rvoice_t*, fluid_sample_t*);
 
   EVENTFUNC_R1(fluid_rvoice_mixer_set_samplerate, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_polyphony, fluid_rvoice_mixer_t*);
+  EVENTFUNC_IR(fluid_rvoice_mixer_set_quality_level, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_reverb_enabled, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_chorus_enabled, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_mix_fx, fluid_rvoice_mixer_t*);
@@ -244,7 +246,8 @@ finished_voice_callback(void* userdata, fluid_rvoice_t* rvoice)
 
 fluid_rvoice_eventhandler_t* 
 new_fluid_rvoice_eventhandler(int is_threadsafe, int queuesize, 
-  int finished_voices_size, int bufs, int fx_bufs, fluid_real_t sample_rate)
+  int finished_voices_size, int bufs, int fx_bufs, fluid_real_t sample_rate,
+  int block_size)
 {
   fluid_rvoice_eventhandler_t* eventhandler = FLUID_NEW(fluid_rvoice_eventhandler_t);
   if (eventhandler == NULL) {
@@ -272,7 +275,7 @@ new_fluid_rvoice_eventhandler(int is_threadsafe, int queuesize,
   if (eventhandler->queue == NULL)
     goto error_recovery;
 
-  eventhandler->mixer = new_fluid_rvoice_mixer(bufs, fx_bufs, sample_rate); 
+  eventhandler->mixer = new_fluid_rvoice_mixer(bufs, fx_bufs, sample_rate, block_size);
   if (eventhandler->mixer == NULL)
     goto error_recovery;
   fluid_rvoice_mixer_set_finished_voices_callback(eventhandler->mixer, 
@@ -79,6 +79,9 @@ struct _fluid_rvoice_mixer_t {
   int polyphony; /**< Read-only: Length of voices array */
   int active_voices; /**< Read-only: Number of non-null voices */
   int current_blockcount;      /**< Read-only: how many blocks to process this time */
+  fluid_real_t quality_linear_amp; /**< Read-only: dynamic quality thresholds handed to each added voice */
+  fluid_real_t quality_none_amp;
+  int block_size;              /**< Read-only: number of samples per block */
 
 #ifdef LADSPA
   fluid_ladspa_fx_t* ladspa_fx; /**< Used by mixer only: Effects unit for LADSPA support. Never created or freed */
@@ -102,51 +105,49 @@ struct _fluid_rvoice_mixer_t {
 static FLUID_INLINE void 
 fluid_rvoice_mixer_process_fx(fluid_rvoice_mixer_t* mixer)
 {
-  int i;
+  int sample_count = mixer->current_blockcount * mixer->block_size;
   fluid_profile_ref_var(prof_ref);
   if (mixer->fx.with_reverb) {
     if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processmix(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.left_buf[0][i],
-				  &mixer->buffers.right_buf[0][i]);
+      fluid_revmodel_processmix(mixer->fx.reverb, 
+                                mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL],
+                                mixer->buffers.left_buf[0],
+                                mixer->buffers.right_buf[0],
+                                sample_count);
     } 
     else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processreplace(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_right_buf[SYNTH_REVERB_CHANNEL][i]);
+      fluid_revmodel_processreplace(mixer->fx.reverb, 
+                                    mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL],
+                                    mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL],
+                                    mixer->buffers.fx_right_buf[SYNTH_REVERB_CHANNEL],
+                                    sample_count);
     }
-    fluid_profile(FLUID_PROF_ONE_BLOCK_REVERB, prof_ref,0,
-	              mixer->current_blockcount * FLUID_BUFSIZE);
+    fluid_profile(FLUID_PROF_ONE_BLOCK_REVERB, prof_ref,0, sample_count);
   }
   
   if (mixer->fx.with_chorus) {
     if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processmix(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-			        &mixer->buffers.left_buf[0][i],
-				&mixer->buffers.right_buf[0][i]);
+      fluid_chorus_processmix(mixer->fx.chorus, 
+                              mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL],
+                              mixer->buffers.left_buf[0],
+                              mixer->buffers.right_buf[0],
+                              sample_count);
     } 
     else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processreplace(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_right_buf[SYNTH_CHORUS_CHANNEL][i]);
+      fluid_chorus_processreplace(mixer->fx.chorus, 
+                                  mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL],
+                                  mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL],
+                                  mixer->buffers.fx_right_buf[SYNTH_CHORUS_CHANNEL],
+                                  sample_count);
     }
-    fluid_profile(FLUID_PROF_ONE_BLOCK_CHORUS, prof_ref,0,
-	              mixer->current_blockcount * FLUID_BUFSIZE);
+    fluid_profile(FLUID_PROF_ONE_BLOCK_CHORUS, prof_ref,0, sample_count);
   }
   
 #ifdef LADSPA
   /* Run the signal through the LADSPA Fx unit. The buffers have already been
    * set up in fluid_rvoice_mixer_set_ladspa. */
   if (mixer->ladspa_fx) {
-      fluid_ladspa_run(mixer->ladspa_fx, mixer->current_blockcount, FLUID_BUFSIZE);
+      fluid_ladspa_run(mixer->ladspa_fx, mixer->current_blockcount, mixer->block_size);
       fluid_check_fpe("LADSPA");
   }
 #endif
@@ -169,25 +170,26 @@ void fluid_rvoice_mixer_set_finished_voices_callback(
 
 /**
  * Synthesize one voice and add to buffer.
- * NOTE: If return value is less than blockcount*FLUID_BUFSIZE, that means 
+ * NOTE: If return value is less than blockcount*block_size, that means 
  * voice has been finished, removed and possibly replaced with another voice.
  * @return Number of samples written 
  */
 static int
-fluid_mix_one(fluid_rvoice_t* rvoice, fluid_real_t** bufs, unsigned int bufcount, int blockcount)
+fluid_mix_one(fluid_rvoice_t* rvoice, fluid_real_t** bufs, unsigned int bufcount,
+              int blockcount, int block_size)
 {
   int i, result = 0;
 
-  FLUID_DECLARE_VLA(fluid_real_t, local_buf, FLUID_BUFSIZE*blockcount);
+  FLUID_DECLARE_VLA(fluid_real_t, local_buf, block_size*blockcount);
 
   for (i=0; i < blockcount; i++) {
-    int s = fluid_rvoice_write(rvoice, &local_buf[FLUID_BUFSIZE*i]);
+    int s = fluid_rvoice_write(rvoice, &local_buf[block_size*i]);
     if (s == -1) {
-      s = FLUID_BUFSIZE; /* Voice is quiet, TODO: optimize away memset/mix */
-      FLUID_MEMSET(&local_buf[FLUID_BUFSIZE*i], 0, FLUID_BUFSIZE*sizeof(fluid_real_t));
+      s = block_size; /* Voice is quiet, TODO: optimize away memset/mix */
+      FLUID_MEMSET(&local_buf[block_size*i], 0, block_size*sizeof(fluid_real_t));
     } 
     result += s;
-    if (s < FLUID_BUFSIZE) {
+    if (s < block_size) {
       break;
     }
   }
@@ -258,13 +260,16 @@ fluid_mixer_buffer_process_finished_voices(fluid_mixer_buffers_t* buffers)
   for (i=0; i < buffers->finished_voice_count; i++) {
     fluid_rvoice_t* v = buffers->finished_voices[i];
     int* av = &buffers->mixer->active_voices; 
-    for (j=0; j < *av; j++) {
-      if (v == buffers->mixer->rvoices[j]) {
-        (*av)--;
-        /* Pack the array */
-        if (j < *av) 
-          buffers->mixer->rvoices[j] = buffers->mixer->rvoices[*av];
+    /* The rvoice knows its position, no need to search for it */
+    j = v->mixer_index;
+    if (j >= 0 && j < *av && v == buffers->mixer->rvoices[j]) {
+      (*av)--;
+      /* Pack the array */
+      if (j < *av) {
+        buffers->mixer->rvoices[j] = buffers->mixer->rvoices[*av];
+        buffers->mixer->rvoices[j]->mixer_index = j;
       }
+      v->mixer_index = -1;
     }
     if (buffers->mixer->remove_voice_callback)
       buffers->mixer->remove_voice_callback(
@@ -288,8 +293,9 @@ fluid_mixer_buffers_render_one(fluid_mixer_buffers_t* buffers,
 			       fluid_rvoice_t* voice, fluid_real_t** bufs, 
 			       unsigned int bufcount)
 {
-  int s = fluid_mix_one(voice, bufs, bufcount, buffers->mixer->current_blockcount);
-  if (s < buffers->mixer->current_blockcount * FLUID_BUFSIZE) {
+  int s = fluid_mix_one(voice, bufs, bufcount, buffers->mixer->current_blockcount,
+                        buffers->mixer->block_size);
+  if (s < buffers->mixer->current_blockcount * buffers->mixer->block_size) {
     fluid_finish_rvoice(buffers, voice);
   }
 }
@@ -316,7 +322,11 @@ fluid_rvoice_mixer_add_voice(fluid_rvoice_mixer_t* mixer, fluid_rvoice_t* voice)
 {
   int i;
 
+  voice->dsp.quality_linear_amp = mixer->quality_linear_amp;
+  voice->dsp.quality_none_amp = mixer->quality_none_amp;
+
   if (mixer->active_voices < mixer->polyphony) {
+    voice->mixer_index = mixer->active_voices;
     mixer->rvoices[mixer->active_voices++] = voice;
     return FLUID_OK;
   }
@@ -330,6 +340,8 @@ fluid_rvoice_mixer_add_voice(fluid_rvoice_mixer_t* mixer, fluid_rvoice_t* voice)
     }
     if (mixer->rvoices[i]->envlfo.volenv.section == FLUID_VOICE_ENVFINISHED) {
       fluid_finish_rvoice(&mixer->buffers, mixer->rvoices[i]);
+      mixer->rvoices[i]->mixer_index = -1;
+      voice->mixer_index = i;
       mixer->rvoices[i] = voice;
       return FLUID_OK;
     }
@@ -402,7 +414,7 @@ fluid_render_loop_singlethread(fluid_rvoice_mixer_t* mixer)
     fluid_mixer_buffers_render_one(&mixer->buffers, mixer->rvoices[i], bufs, 
 				   bufcount);
     fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref,1,
-	              mixer->current_blockcount * FLUID_BUFSIZE);
+	              mixer->current_blockcount * mixer->block_size);
   }
 }
 
@@ -411,7 +423,7 @@ static FLUID_INLINE void
 fluid_mixer_buffers_zero(fluid_mixer_buffers_t* buffers)
 {
   int i;
-  int size = buffers->mixer->current_blockcount * FLUID_BUFSIZE * sizeof(fluid_real_t);
+  int size = buffers->mixer->current_blockcount * buffers->mixer->block_size * sizeof(fluid_real_t);
   /* TODO: Optimize by only zero out the buffers we actually use later on. */
   for (i=0; i < buffers->buf_count; i++) {
     FLUID_MEMSET(buffers->left_buf[i], 0, size);
@@ -434,7 +446,7 @@ fluid_mixer_buffers_init(fluid_mixer_buffers_t* buffers, fluid_rvoice_mixer_t* m
   buffers->buf_count = buffers->mixer->buffers.buf_count;
   buffers->fx_buf_count = buffers->mixer->buffers.fx_buf_count;
   buffers->buf_blocks = buffers->mixer->buffers.buf_blocks;
-  samplecount = FLUID_BUFSIZE * buffers->buf_blocks;
+  samplecount = buffers->mixer->block_size * buffers->buf_blocks;
   
  
   /* Left and right audio buffers */
@@ -520,9 +532,11 @@ fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t samp
 /**
  * @param buf_count number of primary stereo buffers
  * @param fx_buf_count number of stereo effect buffers
+ * @param block_size number of samples synthesized per block
  */
 fluid_rvoice_mixer_t* 
-new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate)
+new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate,
+                       int block_size)
 {
   fluid_rvoice_mixer_t* mixer = FLUID_NEW(fluid_rvoice_mixer_t);
   if (mixer == NULL) {
@@ -532,7 +546,10 @@ new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate
   FLUID_MEMSET(mixer, 0, sizeof(fluid_rvoice_mixer_t));
   mixer->buffers.buf_count = buf_count;
   mixer->buffers.fx_buf_count = fx_buf_count;
-  mixer->buffers.buf_blocks = FLUID_MIXER_MAX_BUFFERS_DEFAULT;
+  mixer->block_size = block_size;
+  mixer->buffers.buf_blocks = FLUID_MIXER_MAX_SAMPLES_DEFAULT / block_size;
+  if (mixer->buffers.buf_blocks < 1)
+    mixer->buffers.buf_blocks = 1;
   
   /* allocate the reverb module */
   mixer->fx.reverb = new_fluid_revmodel(sample_rate);
@@ -725,12 +742,26 @@ int fluid_rvoice_mixer_get_bufcount(fluid_rvoice_mixer_t* mixer)
     return mixer->buffers.buf_blocks;
 }
 
-#if WITH_PROFILING
+/**
+ * Set the output amplitude below which voices are synthesized with at most
+ * the given interpolation method, see fluid_rvoice_write(). Applies to voices
+ * added afterwards.
+ * @param interp_method FLUID_INTERP_LINEAR or FLUID_INTERP_NONE
+ * @param amp Amplitude threshold, 0 to disable
+ */
+void fluid_rvoice_mixer_set_quality_level(fluid_rvoice_mixer_t* mixer,
+                                          int interp_method, fluid_real_t amp)
+{
+  if (interp_method == FLUID_INTERP_NONE)
+    mixer->quality_none_amp = amp;
+  else if (interp_method == FLUID_INTERP_LINEAR)
+    mixer->quality_linear_amp = amp;
+}
+
 int fluid_rvoice_mixer_get_active_voices(fluid_rvoice_mixer_t* mixer)
 {
 	return mixer->active_voices;
 }
-#endif
 
 #ifdef ENABLE_MIXER_THREADS
 
@@ -797,7 +828,7 @@ static void
 fluid_mixer_buffers_mix(fluid_mixer_buffers_t* dest, fluid_mixer_buffers_t* src)
 {
   int i,j;
-  int scount = dest->mixer->current_blockcount * FLUID_BUFSIZE;
+  int scount = dest->mixer->current_blockcount * dest->mixer->block_size;
   int minbuf;
   
   minbuf = dest->buf_count;
@@ -853,7 +884,7 @@ static void
 fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
 {
   int i, bufcount;
-  //int scount = mixer->current_blockcount * FLUID_BUFSIZE;
+  //int scount = mixer->current_blockcount * mixer->block_size;
   FLUID_DECLARE_VLA(fluid_real_t*, bufs, 
 		    mixer->buffers.buf_count * 2 + mixer->buffers.fx_buf_count * 2);
   // How many threads should we start this time?
@@ -885,7 +916,7 @@ fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
       fluid_profile_ref_var(prof_ref);
       fluid_mixer_buffers_render_one(&mixer->buffers, rvoice, bufs, bufcount);
       fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref,1,
-                    mixer->current_blockcount * FLUID_BUFSIZE);
+                    mixer->current_blockcount * mixer->block_size);
       //test++;
     }
     else {
@@ -971,7 +1002,7 @@ fluid_rvoice_mixer_set_threads(fluid_rvoice_mixer_t* mixer, int thread_count,
 
 /**
  * Synthesize audio into buffers
- * @param blockcount number of blocks to render, each having FLUID_BUFSIZE samples 
+ * @param blockcount number of blocks to render, each having block_size samples 
  * @return number of blocks rendered
  */
 int 
@@ -985,7 +1016,7 @@ fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount)
   // Zero buffers
   fluid_mixer_buffers_zero(&mixer->buffers);
   fluid_profile(FLUID_PROF_ONE_BLOCK_CLEAR, prof_ref, mixer->active_voices,
-                mixer->current_blockcount * FLUID_BUFSIZE);
+                mixer->current_blockcount * mixer->block_size);
   
 #ifdef ENABLE_MIXER_THREADS
   if (mixer->thread_count > 0)
@@ -994,7 +1025,7 @@ fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount)
 #endif
     fluid_render_loop_singlethread(mixer);
   fluid_profile(FLUID_PROF_ONE_BLOCK_VOICES, prof_ref, mixer->active_voices,
-                mixer->current_blockcount * FLUID_BUFSIZE);
+                mixer->current_blockcount * mixer->block_size);
     
 
   // Process reverb & chorus
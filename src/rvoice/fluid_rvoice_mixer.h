@@ -28,7 +28,8 @@
 
 typedef struct _fluid_rvoice_mixer_t fluid_rvoice_mixer_t;
 
-#define FLUID_MIXER_MAX_BUFFERS_DEFAULT (8192/FLUID_BUFSIZE) 
+/* Size of the mixer buffers in samples, rounded down to whole blocks */
+#define FLUID_MIXER_MAX_SAMPLES_DEFAULT 8192
 
 
 void fluid_rvoice_mixer_set_finished_voices_callback(
@@ -43,11 +44,9 @@ int fluid_rvoice_mixer_get_bufs(fluid_rvoice_mixer_t* mixer,
 int fluid_rvoice_mixer_get_fx_bufs(fluid_rvoice_mixer_t* mixer, 
                                   fluid_real_t*** fx_left, fluid_real_t*** fx_right);
 int fluid_rvoice_mixer_get_bufcount(fluid_rvoice_mixer_t* mixer);
-#if WITH_PROFILING
 int fluid_rvoice_mixer_get_active_voices(fluid_rvoice_mixer_t* mixer);
-#endif
 fluid_rvoice_mixer_t* new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, 
-					     fluid_real_t sample_rate);
+					     fluid_real_t sample_rate, int block_size);
 
 void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t*);
 
@@ -55,6 +54,8 @@ void fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t
 void fluid_rvoice_mixer_set_reverb_enabled(fluid_rvoice_mixer_t* mixer, int on);
 void fluid_rvoice_mixer_set_chorus_enabled(fluid_rvoice_mixer_t* mixer, int on);
 void fluid_rvoice_mixer_set_mix_fx(fluid_rvoice_mixer_t* mixer, int on);
+void fluid_rvoice_mixer_set_quality_level(fluid_rvoice_mixer_t* mixer,
+                                          int interp_method, fluid_real_t amp);
 int fluid_rvoice_mixer_set_polyphony(fluid_rvoice_mixer_t* handler, int value);
 int fluid_rvoice_mixer_add_voice(fluid_rvoice_mixer_t* mixer, fluid_rvoice_t* voice);
 void fluid_rvoice_mixer_set_chorus_params(fluid_rvoice_mixer_t* mixer, int set, 
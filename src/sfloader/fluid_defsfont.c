@@ -26,6 +26,8 @@
 #include "fluid_sfont.h"
 #include "fluid_sys.h"
 #include "fluid_synth.h"
+#include "fluid_hash.h"
+#include "fluid_ringbuffer.h"
 
 #if LIBSNDFILE_SUPPORT
 #include <sndfile.h>
@@ -152,7 +154,7 @@ fluid_defsfont_sfont_get_preset(fluid_sfont_t* sfont, unsigned int bank, unsigne
   preset->get_banknum = fluid_defpreset_preset_get_banknum;
   preset->get_num = fluid_defpreset_preset_get_num;
   preset->noteon = fluid_defpreset_preset_noteon;
-  preset->notify = NULL;
+  preset->notify = fluid_defpreset_preset_notify;
 
   return preset;
 }
@@ -169,7 +171,7 @@ int fluid_defsfont_sfont_iteration_next(fluid_sfont_t* sfont, fluid_preset_t* pr
   preset->get_banknum = fluid_defpreset_preset_get_banknum;
   preset->get_num = fluid_defpreset_preset_get_num;
   preset->noteon = fluid_defpreset_preset_noteon;
-  preset->notify = NULL;
+  preset->notify = fluid_defpreset_preset_notify;
 
   return fluid_defsfont_iteration_next(fluid_sfont_get_data(sfont), preset);
 }
@@ -229,6 +231,9 @@ typedef struct _fluid_cached_sampledata_t {
   
   char* sample24data;
   unsigned int sample24size;
+
+  void* mapping;           /* the mapped part of the file, if the data is mapped */
+  size_t mapping_size;
 } fluid_cached_sampledata_t;
 
 static fluid_cached_sampledata_t* all_cached_sampledata = NULL;
@@ -251,6 +256,57 @@ static int fluid_get_file_modification_time(char *filename, time_t *modification
 #endif
 }
 
+#if defined(HAVE_SYS_MMAN_H) && !defined(__OS2__)
+/*
+ * Map the sample data of a SoundFont file read-only into memory, from the
+ * page holding the first sample byte up to the end of the 24 bit data.
+ * Returns FLUID_OK or FLUID_FAILED if the file can't be mapped.
+ */
+static int fluid_sampledata_mmap(const char *filename,
+                                 unsigned int samplepos, unsigned int samplesize,
+                                 unsigned int sample24pos, unsigned int sample24size,
+                                 void **mapping, size_t *mapping_size, size_t *mapping_offset)
+{
+  struct stat buf;
+  off_t offset, end;
+  void *addr;
+  int fd;
+
+  end = (off_t) samplepos + samplesize;
+  if ((sample24pos > 0) && ((off_t) sample24pos + sample24size > end)) {
+    end = (off_t) sample24pos + sample24size;
+  }
+  offset = samplepos - samplepos % sysconf(_SC_PAGESIZE);
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return FLUID_FAILED;
+  }
+
+  /* accessing a mapping beyond the end of the file would crash */
+  if ((fstat(fd, &buf) == -1) || (buf.st_size < end) || (end == offset)) {
+    close(fd);
+    return FLUID_FAILED;
+  }
+
+  addr = mmap(NULL, end - offset, PROT_READ, MAP_PRIVATE, fd, offset);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return FLUID_FAILED;
+  }
+
+  *mapping = addr;
+  *mapping_size = end - offset;
+  *mapping_offset = offset;
+  return FLUID_OK;
+}
+
+#define fluid_sampledata_munmap(_p,_n)  munmap(_p, _n)
+#else
+#define fluid_sampledata_mmap(_f, _p, _s, _p24, _s24, _m, _ms, _mo)  FLUID_FAILED
+#define fluid_sampledata_munmap(_p,_n)
+#endif
+
 static int fluid_cached_sampledata_load(char *filename,
                                         unsigned int samplepos,
                                         unsigned int samplesize,
@@ -259,6 +315,7 @@ static int fluid_cached_sampledata_load(char *filename,
                                         unsigned int sample24size,
                                         char **sample24data,
                                         int try_mlock,
+                                        int try_mmap,
                                         const fluid_file_callbacks_t* fcbs)
 {
   fluid_file fd = NULL;
@@ -266,6 +323,8 @@ static int fluid_cached_sampledata_load(char *filename,
   char  *loaded_sample24data = NULL;
   fluid_cached_sampledata_t* cached_sampledata = NULL;
   time_t modification_time;
+  void *mapping = NULL;
+  size_t mapping_size = 0, mapping_offset = 0;
 
   fluid_mutex_lock(cached_sampledata_mutex);
 
@@ -302,6 +361,20 @@ static int fluid_cached_sampledata_load(char *filename,
     goto success_exit;
   }
 
+  /* The samples of the file can be used in place if they are read from the
+   * file system and don't need to be byte swapped */
+  if (try_mmap && !FLUID_IS_BIG_ENDIAN && (fcbs->fopen == default_fopen)) {
+    if (fluid_sampledata_mmap(filename, samplepos, samplesize, sample24pos, sample24size,
+                              &mapping, &mapping_size, &mapping_offset) == FLUID_OK) {
+      loaded_sampledata = (short*) ((char*) mapping + (samplepos - mapping_offset));
+      if (sample24pos > 0) {
+        loaded_sample24data = (char*) mapping + (sample24pos - mapping_offset);
+      }
+      goto cache_entry;
+    }
+    FLUID_LOG(FLUID_WARN, "Failed to map the sample data of the soundfont file, reading it instead.");
+  }
+
   fd = fcbs->fopen(filename);
   if (fd == NULL) {
     FLUID_LOG(FLUID_ERR, "Can't open soundfont file");
@@ -346,6 +419,7 @@ static int fluid_cached_sampledata_load(char *filename,
   fd = NULL;
 
 
+ cache_entry:
   cached_sampledata = (fluid_cached_sampledata_t*) FLUID_MALLOC(sizeof(fluid_cached_sampledata_t));
   if (cached_sampledata == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory.");
@@ -362,7 +436,8 @@ static int fluid_cached_sampledata_load(char *filename,
       cached_sampledata->mlock = try_mlock;
   }
 
-  /* If this machine is big endian, the sample have to byte swapped  */
+  /* If this machine is big endian, the sample have to byte swapped
+   * (mapped sample data is only used on little endian machines) */
   if (FLUID_IS_BIG_ENDIAN) {
     unsigned char* cbuf;
     unsigned char hi, lo;
@@ -389,6 +464,8 @@ static int fluid_cached_sampledata_load(char *filename,
   cached_sampledata->samplesize = samplesize;
   cached_sampledata->sample24data = loaded_sample24data;
   cached_sampledata->sample24size = sample24size;
+  cached_sampledata->mapping = mapping;
+  cached_sampledata->mapping_size = mapping_size;
 
   cached_sampledata->next = all_cached_sampledata;
   all_cached_sampledata = cached_sampledata;
@@ -405,8 +482,12 @@ static int fluid_cached_sampledata_load(char *filename,
     fcbs->fclose(fd);
   }
   
-  FLUID_FREE(loaded_sampledata);
-  FLUID_FREE(loaded_sample24data);
+  if (mapping != NULL) {
+    fluid_sampledata_munmap(mapping, mapping_size);
+  } else {
+    FLUID_FREE(loaded_sampledata);
+    FLUID_FREE(loaded_sample24data);
+  }
 
   if (cached_sampledata != NULL) {
       FLUID_FREE(cached_sampledata->filename);
@@ -438,8 +519,12 @@ static int fluid_cached_sampledata_unload(const short *sampledata)
           fluid_munlock(cached_sampledata->sampledata, cached_sampledata->samplesize);
           fluid_munlock(cached_sampledata->sample24data, cached_sampledata->sample24size);
         }
-        FLUID_FREE(cached_sampledata->sampledata);
-        FLUID_FREE(cached_sampledata->sample24data);
+        if (cached_sampledata->mapping != NULL) {
+          fluid_sampledata_munmap(cached_sampledata->mapping, cached_sampledata->mapping_size);
+        } else {
+          FLUID_FREE(cached_sampledata->sampledata);
+          FLUID_FREE(cached_sampledata->sample24data);
+        }
         FLUID_FREE(cached_sampledata->filename);
 
         if (prev != NULL) {
@@ -475,111 +560,1648 @@ static int fluid_cached_sampledata_unload(const short *sampledata)
 
 /***************************************************************
  *
- *                           SFONT
+ *                       SAMPLE STREAMING
  */
 
+/* When streaming or loading samples on demand, the sample data of a
+ * SoundFont is kept in sparse anonymous mappings of the size of the sample
+ * chunks, and only the resident part of a sample is read from the file:
+ * its head and its loop when streaming, or all of it otherwise.
+ *
+ * The resident parts are read when the file is loaded, or by a background
+ * thread once a preset using the sample is selected or played if loading on
+ * demand. When streaming, the thread reads the rest of a sample as soon as
+ * a voice starts playing it. The synthesis only queues events for the
+ * thread and never touches the file. Parts that weren't read yet read as
+ * zero, so a voice that gets ahead of the thread plays silence instead of
+ * blocking the synthesis.
+ *
+ * The thread also releases the streamed part of a sample, and the resident
+ * part when loading on demand, once the sample hasn't been used for the
+ * unload delay. */
+
+#if defined(HAVE_SYS_MMAN_H) && !defined(__OS2__) && defined(MADV_DONTNEED)
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define FLUID_STREAM_CHUNK         32768 /* sample points read for a sample at once */
+#define FLUID_STREAM_QUEUE_SIZE    1024  /* max events waiting for the thread */
+#define FLUID_STREAM_LOOP_GUARD    8     /* sample points around the loop kept in ram */
+#define FLUID_STREAM_IDLE_MSEC     5     /* sleep time of the thread if nothing is to be read */
+
+/* The events queued for the streaming thread */
+enum fluid_sample_stream_event_type {
+  FLUID_STREAM_PLAY,           /* a voice starts playing a sample */
+  FLUID_STREAM_SELECT          /* a preset is selected on a channel */
+};
+
+typedef struct {
+  int type;
+  void* data;                  /* the fluid_sample_t played or the fluid_defpreset_t selected */
+} fluid_sample_stream_event_t;
+
+/* The state of a sample, only used by the thread once it is started
+ * except for selected and pending */
+typedef struct {
+  fluid_sample_t* sample;
+  unsigned int end;          /* the sample point after the last one of the sample */
+  unsigned int head_end;     /* the sample point after the head kept in ram */
+  unsigned int loop_start;   /* the sample points around the loop kept in ram */
+  unsigned int loop_end;
+  unsigned int read_pos;     /* the sample point after the streamed ones, head_end if not streamed */
+  unsigned int last_used;    /* the time at which the sample was last seen in use */
+  int active;                /* is the sample in the active list? */
+  int loaded;                /* is the resident part in ram? */
+  int streaming;             /* is the rest of the sample being read? */
+  fluid_atomic_int_t selected; /* the number of selected presets using the sample, counted by the API */
+  fluid_atomic_int_t pending; /* the number of voices about to start, which don't hold a reference yet */
+} fluid_sample_stream_t;
+
+struct _fluid_sample_streamer_t {
+  fluid_file_callbacks_t fcbs;   /* a copy of the callbacks the file was opened with */
+  void* fd;
+  unsigned int head_msec;        /* the length of the resident heads, 0 if not streaming */
+  unsigned int unload_msec;
+  int on_demand;                 /* are the resident parts loaded on demand? */
+  size_t pagesize;
+
+  unsigned int samplepos;
+  unsigned int samplecount;      /* the number of sample points in the file */
+  short* sampledata;
+  unsigned int sample24pos;
+  unsigned int sample24size;
+  char* sample24data;
+
+  fluid_hashtable_t* streams;    /* the fluid_sample_stream_t of the samples */
+  fluid_list_t* active;          /* the streams being read or kept in ram, only used by the thread */
+  fluid_ringbuffer_t* queue;     /* the fluid_sample_stream_event_t for the thread */
+  fluid_thread_t* thread;
+  fluid_atomic_int_t rescan;     /* was a select event dropped because the queue was full? */
+  fluid_atomic_int_t quit;
+};
+
+static void delete_fluid_sample_stream(void* stream)
+{
+  FLUID_FREE(stream);
+}
+
 /*
- * new_fluid_defsfont
+ * Read the sample points first to last - 1 from the file.
  */
-fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
+static int
+fluid_sample_streamer_read(fluid_sample_streamer_t* streamer, unsigned int first, unsigned int last)
 {
-  fluid_defsfont_t* sfont;
-  int i;
-
-  sfont = FLUID_NEW(fluid_defsfont_t);
-  if (sfont == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    return NULL;
+  if (last > streamer->samplecount) {
+    last = streamer->samplecount;
+  }
+  if (first >= last) {
+    return FLUID_OK;
   }
 
-  FLUID_MEMSET(sfont, 0, sizeof(*sfont));
-  
-  fluid_settings_getint(settings, "synth.lock-memory", &sfont->mlock);
+  if ((streamer->fcbs.fseek(streamer->fd, streamer->samplepos + 2 * first, SEEK_SET) == FLUID_FAILED)
+      || (streamer->fcbs.fread(streamer->sampledata + first, 2 * (last - first), streamer->fd) == FLUID_FAILED)) {
+    return FLUID_FAILED;
+  }
 
-  /* Initialise preset cache, so we don't have to call malloc on program changes.
-     Usually, we have at most one preset per channel plus one temporarily used,
-     so optimise for that case. */
-  fluid_settings_getint(settings, "synth.midi-channels", &sfont->preset_stack_capacity);
-  sfont->preset_stack_capacity++;
-  
-  sfont->preset_stack = FLUID_ARRAY(fluid_preset_t*, sfont->preset_stack_capacity);
-  if (!sfont->preset_stack) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    FLUID_FREE(sfont);
-    return NULL;
+  if (FLUID_IS_BIG_ENDIAN) {
+    unsigned char* cbuf = (unsigned char*) (streamer->sampledata + first);
+    unsigned int i;
+    for (i = first; i < last; i++, cbuf += 2) {
+      streamer->sampledata[i] = (short) ((cbuf[1] << 8) | cbuf[0]);
+    }
   }
 
-  for (i = 0; i < sfont->preset_stack_capacity; i++) {
-    sfont->preset_stack[i] = FLUID_NEW(fluid_preset_t);
-    if (!sfont->preset_stack[i]) {
-      FLUID_LOG(FLUID_ERR, "Out of memory");
-      delete_fluid_defsfont(sfont);
-      return NULL;
+  if (streamer->sample24data != NULL) {
+    if (last > streamer->sample24size) {
+      last = streamer->sample24size;
+    }
+    if ((first < last)
+        && ((streamer->fcbs.fseek(streamer->fd, streamer->sample24pos + first, SEEK_SET) == FLUID_FAILED)
+            || (streamer->fcbs.fread(streamer->sample24data + first, last - first, streamer->fd) == FLUID_FAILED))) {
+      return FLUID_FAILED;
     }
-    sfont->preset_stack_size++;
   }
 
-  return sfont;
+  return FLUID_OK;
 }
 
 /*
- * delete_fluid_defsfont
+ * Give the pages holding only the bytes first to last - 1 of a buffer back
+ * to the system.
  */
-int delete_fluid_defsfont(fluid_defsfont_t* sfont)
+static void
+fluid_sample_streamer_discard(fluid_sample_streamer_t* streamer, char* data, size_t first, size_t last)
 {
-  fluid_list_t *list;
-  fluid_defpreset_t* preset;
+  first = (first + streamer->pagesize - 1) / streamer->pagesize * streamer->pagesize;
+  last = last / streamer->pagesize * streamer->pagesize;
+
+  if (first < last) {
+    madvise(data + first, last - first, MADV_DONTNEED);
+  }
+}
+
+/*
+ * Release the sample points first to last - 1.
+ */
+static void
+fluid_sample_streamer_release(fluid_sample_streamer_t* streamer, unsigned int first, unsigned int last)
+{
+  if (first >= last) {
+    return;
+  }
+
+  fluid_sample_streamer_discard(streamer, (char*) streamer->sampledata, 2 * (size_t) first, 2 * (size_t) last);
+
+  if (streamer->sample24data != NULL) {
+    fluid_sample_streamer_discard(streamer, streamer->sample24data, first,
+                                  (last < streamer->sample24size) ? last : streamer->sample24size);
+  }
+}
+
+/*
+ * Read the resident part of a sample.
+ */
+static int
+fluid_sample_stream_load(fluid_sample_streamer_t* streamer, fluid_sample_stream_t* stream)
+{
+  fluid_sample_t* sample = stream->sample;
+
+  if ((fluid_sample_streamer_read(streamer, sample->start, stream->head_end) != FLUID_OK)
+      || (fluid_sample_streamer_read(streamer,
+                                     (stream->loop_start > stream->head_end) ? stream->loop_start : stream->head_end,
+                                     stream->loop_end) != FLUID_OK)) {
+    FLUID_LOG(FLUID_ERR, "Failed to read the data of sample '%s'", sample->name);
+    return FLUID_FAILED;
+  }
+
+  stream->loaded = TRUE;
+  fluid_voice_optimize_sample(sample);
+  return FLUID_OK;
+}
+
+/*
+ * Release the streamed part of a sample, except for the loop.
+ */
+static void
+fluid_sample_stream_release(fluid_sample_streamer_t* streamer, fluid_sample_stream_t* stream)
+{
+  if (stream->loop_start > stream->head_end) {
+    fluid_sample_streamer_release(streamer, stream->head_end,
+                                  (stream->loop_start < stream->read_pos) ? stream->loop_start : stream->read_pos);
+  }
+
+  fluid_sample_streamer_release(streamer,
+                                (stream->loop_end > stream->head_end) ? stream->loop_end : stream->head_end,
+                                stream->read_pos);
+
+  stream->read_pos = stream->head_end;
+  stream->streaming = FALSE;
+}
+
+/*
+ * Is a sample used by a selected preset, a voice or a voice about to start?
+ */
+static int
+fluid_sample_stream_in_use(fluid_sample_stream_t* stream)
+{
+  /* A starting voice takes its reference before it is unpinned, so
+   * pending must be checked first */
+  return (fluid_atomic_int_get(&stream->pending) > 0)
+    || (stream->sample->refcount > 0) || (fluid_atomic_int_get(&stream->selected) > 0);
+}
+
+/*
+ * Release the streamed part of a sample that hasn't been used for the
+ * unload delay, and the resident part too if it was loaded on demand and
+ * no selected preset uses it anymore.
+ */
+static void
+fluid_sample_stream_unload(fluid_sample_streamer_t* streamer, fluid_sample_stream_t* stream)
+{
+  fluid_sample_stream_release(streamer, stream);
+
+  /* The sample may just have been played again */
+  if (streamer->on_demand && !fluid_sample_stream_in_use(stream)
+      && ((int) (fluid_curtime() - stream->last_used) > (int) streamer->unload_msec)) {
+    fluid_sample_streamer_release(streamer, stream->sample->start, stream->end);
+    stream->loaded = FALSE;
+  }
+}
+
+/*
+ * Make a stream known to the thread, so that it is read and released.
+ */
+static void
+fluid_sample_stream_activate(fluid_sample_streamer_t* streamer, fluid_sample_stream_t* stream)
+{
+  if (!stream->active) {
+    stream->active = TRUE;
+    streamer->active = fluid_list_prepend(streamer->active, stream);
+  }
+}
+
+/*
+ * Read the resident part of a sample a voice starts playing, if it wasn't
+ * read yet, and start reading the rest of it.
+ */
+static void
+fluid_sample_streamer_play(fluid_sample_streamer_t* streamer, fluid_sample_t* sample, unsigned int now)
+{
+  fluid_sample_stream_t* stream = fluid_hashtable_lookup(streamer->streams, sample);
+
+  if (stream == NULL) {
+    return;
+  }
+
+  stream->last_used = now;
+  if (!stream->loaded) {
+    fluid_sample_stream_load(streamer, stream);
+  }
+  stream->streaming = stream->loaded;
+  fluid_sample_stream_activate(streamer, stream);
+}
+
+/*
+ * Call func for the stream of each sample of a preset handled by the
+ * streamer.
+ */
+static void
+fluid_sample_streamer_foreach_preset_stream(fluid_sample_streamer_t* streamer, fluid_defpreset_t* preset,
+                                            void (*func)(fluid_sample_stream_t* stream, void* data),
+                                            void* data)
+{
+  fluid_preset_zone_t* preset_zone;
+  fluid_inst_zone_t* inst_zone;
+  fluid_sample_stream_t* stream;
   fluid_sample_t* sample;
 
-  fluid_return_val_if_fail(sfont != NULL, FLUID_OK);
-  
-  /* Check that no samples are currently used */
-  for (list = sfont->sample; list; list = fluid_list_next(list)) {
-    sample = (fluid_sample_t*) fluid_list_get(list);
-    if (sample->refcount != 0) {
-      return FLUID_FAILED;
+  for (preset_zone = fluid_defpreset_get_zone(preset); preset_zone;
+       preset_zone = fluid_preset_zone_next(preset_zone)) {
+    for (inst_zone = fluid_inst_get_zone(fluid_preset_zone_get_inst(preset_zone)); inst_zone;
+         inst_zone = fluid_inst_zone_next(inst_zone)) {
+      sample = fluid_inst_zone_get_sample(inst_zone);
+      stream = (sample != NULL) ? fluid_hashtable_lookup(streamer->streams, sample) : NULL;
+      if (stream != NULL) {
+        (*func)(stream, data);
+      }
     }
   }
+}
 
-  if (sfont->filename != NULL) {
-    FLUID_FREE(sfont->filename);
+typedef struct {
+  fluid_sample_streamer_t* streamer;
+  unsigned int now;
+} fluid_sample_stream_select_data_t;
+
+/*
+ * Read the resident part of a sample of a selected preset, if the preset
+ * is still selected.
+ */
+static void
+fluid_sample_stream_select(fluid_sample_stream_t* stream, void* data)
+{
+  fluid_sample_stream_select_data_t* select = (fluid_sample_stream_select_data_t*) data;
+
+  if (fluid_atomic_int_get(&stream->selected) <= 0) {
+    return;
   }
 
-  for (list = sfont->sample; list; list = fluid_list_next(list)) {
-    delete_fluid_sample((fluid_sample_t*) fluid_list_get(list));
+  stream->last_used = select->now;
+  if (!stream->loaded) {
+    fluid_sample_stream_load(select->streamer, stream);
   }
 
-  if (sfont->sample) {
-    delete_fluid_list(sfont->sample);
+  /* The thread releases unused samples it knows about */
+  fluid_sample_stream_activate(select->streamer, stream);
+}
+
+static int
+fluid_sample_streamer_rescan_stream(void* key, void* value, void* data)
+{
+  fluid_sample_stream_select((fluid_sample_stream_t*) value, data);
+  return FALSE;
+}
+
+static fluid_thread_return_t
+fluid_sample_streamer_run(void* data)
+{
+  fluid_sample_streamer_t* streamer = (fluid_sample_streamer_t*) data;
+  fluid_sample_stream_t* stream;
+  fluid_sample_stream_event_t* event;
+  fluid_sample_stream_select_data_t select_data;
+  fluid_list_t *list, *next;
+  unsigned int now, last;
+  int busy;
+
+  while (!fluid_atomic_int_get(&streamer->quit)) {
+    now = fluid_curtime();
+
+    /* Load the samples of the presets selected and the voices started
+     * since the last round */
+    select_data.streamer = streamer;
+    select_data.now = now;
+    while ((event = fluid_ringbuffer_get_outptr(streamer->queue)) != NULL) {
+      if (event->type == FLUID_STREAM_PLAY) {
+        fluid_sample_streamer_play(streamer, (fluid_sample_t*) event->data, now);
+      }
+      else {
+        fluid_sample_streamer_foreach_preset_stream(streamer, (fluid_defpreset_t*) event->data,
+                                                    fluid_sample_stream_select, &select_data);
+      }
+      fluid_ringbuffer_next_outptr(streamer->queue);
+    }
+
+    /* Select events were lost, look for the samples of all selected presets */
+    if (fluid_atomic_int_compare_and_exchange(&streamer->rescan, TRUE, FALSE)) {
+      fluid_hashtable_foreach(streamer->streams, fluid_sample_streamer_rescan_stream, &select_data);
+    }
+
+    /* Read the next chunk of each sample in turn, and release the
+     * samples that haven't been used for a while */
+    busy = FALSE;
+    for (list = streamer->active; list; list = next) {
+      next = fluid_list_next(list);
+      stream = (fluid_sample_stream_t*) fluid_list_get(list);
+
+      if (stream->streaming && (stream->read_pos < stream->end)) {
+        last = (stream->end - stream->read_pos > FLUID_STREAM_CHUNK)
+          ? stream->read_pos + FLUID_STREAM_CHUNK : stream->end;
+
+        if (fluid_sample_streamer_read(streamer, stream->read_pos, last) != FLUID_OK) {
+          FLUID_LOG(FLUID_ERR, "Failed to stream the data of sample '%s'", stream->sample->name);
+          last = stream->end;
+        }
+
+        stream->read_pos = last;
+        busy = TRUE;
+      }
+
+      if (fluid_sample_stream_in_use(stream)) {
+        stream->last_used = now;
+      }
+      else if ((int) (now - stream->last_used) > (int) streamer->unload_msec) {
+        fluid_sample_stream_unload(streamer, stream);
+        stream->active = FALSE;
+        streamer->active = fluid_list_remove(streamer->active, stream);
+      }
+    }
+
+    if (!busy) {
+      fluid_msleep(FLUID_STREAM_IDLE_MSEC);
+    }
   }
 
-  if (sfont->sampledata != NULL) {
-    fluid_cached_sampledata_unload(sfont->sampledata);
+  return FLUID_THREAD_RETURN_VALUE;
+}
+
+static void delete_fluid_sample_streamer(fluid_sample_streamer_t* streamer);
+
+/*
+ * Create the streamer of the sample data of a SoundFont and set up its
+ * (still empty) sample data buffers. Returns NULL on failure.
+ */
+static fluid_sample_streamer_t*
+new_fluid_sample_streamer(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* fcbs)
+{
+  fluid_sample_streamer_t* streamer;
+  void* addr;
+
+  streamer = FLUID_NEW(fluid_sample_streamer_t);
+  if (streamer == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
   }
 
-  while (sfont->preset_stack_size > 0)
-    FLUID_FREE(sfont->preset_stack[--sfont->preset_stack_size]);
-  FLUID_FREE(sfont->preset_stack);
+  FLUID_MEMSET(streamer, 0, sizeof(*streamer));
 
-  preset = sfont->preset;
-  while (preset != NULL) {
-    sfont->preset = preset->next;
-    delete_fluid_defpreset(preset);
-    preset = sfont->preset;
+  streamer->fcbs = *fcbs;
+  streamer->head_msec = sfont->stream_head;
+  streamer->unload_msec = sfont->unload_delay;
+  streamer->on_demand = sfont->dynamic_loading;
+  streamer->pagesize = sysconf(_SC_PAGESIZE);
+  streamer->samplepos = sfont->samplepos;
+  streamer->samplecount = sfont->samplesize / 2;
+
+  if (sfont->samplesize == 0) {
+    goto error_exit;
+  }
+
+  addr = mmap(NULL, sfont->samplesize, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (addr == MAP_FAILED) {
+    goto error_exit;
+  }
+  streamer->sampledata = (short*) addr;
+
+  if ((sfont->sample24pos > 0) && (sfont->sample24size > 0)) {
+    addr = mmap(NULL, sfont->sample24size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+      goto error_exit;
+    }
+    streamer->sample24pos = sfont->sample24pos;
+    streamer->sample24size = sfont->sample24size;
+    streamer->sample24data = (char*) addr;
+  }
+
+  streamer->fd = fcbs->fopen(sfont->filename);
+  streamer->streams = new_fluid_hashtable_full(NULL, NULL, NULL, delete_fluid_sample_stream);
+  streamer->queue = new_fluid_ringbuffer(FLUID_STREAM_QUEUE_SIZE, sizeof(fluid_sample_stream_event_t));
+  if ((streamer->fd == NULL) || (streamer->streams == NULL) || (streamer->queue == NULL)) {
+    goto error_exit;
+  }
+
+  sfont->sampledata = streamer->sampledata;
+  sfont->sample24data = streamer->sample24data;
+  return streamer;
+
+ error_exit:
+  delete_fluid_sample_streamer(streamer);
+  return NULL;
+}
+
+static void
+delete_fluid_sample_streamer(fluid_sample_streamer_t* streamer)
+{
+  if (streamer->thread != NULL) {
+    fluid_atomic_int_set(&streamer->quit, TRUE);
+    fluid_thread_join(streamer->thread);
+    delete_fluid_thread(streamer->thread);
+  }
+
+  if (streamer->fd != NULL) {
+    streamer->fcbs.fclose(streamer->fd);
+  }
+
+  if (streamer->streams != NULL) {
+    delete_fluid_hashtable(streamer->streams);
+  }
+  delete_fluid_list(streamer->active);
+
+  if (streamer->queue != NULL) {
+    delete_fluid_ringbuffer(streamer->queue);
+  }
+
+  if (streamer->sampledata != NULL) {
+    munmap(streamer->sampledata, 2 * (size_t) streamer->samplecount);
+  }
+  if (streamer->sample24data != NULL) {
+    munmap(streamer->sample24data, streamer->sample24size);
+  }
+
+  FLUID_FREE(streamer);
+}
+
+/*
+ * Add a sample to the streamer, and read its resident part unless it is
+ * loaded on demand.
+ */
+static int
+fluid_sample_streamer_add(fluid_sample_streamer_t* streamer, fluid_sample_t* sample)
+{
+  fluid_sample_stream_t* stream;
+  double head;
+
+  if (!sample->valid) {
+    return FLUID_OK;
+  }
+
+  stream = FLUID_NEW(fluid_sample_stream_t);
+  if (stream == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+
+  FLUID_MEMSET(stream, 0, sizeof(*stream));
+  stream->sample = sample;
+  stream->end = (sample->end < streamer->samplecount) ? sample->end + 1 : streamer->samplecount;
+
+  if (streamer->head_msec > 0) {
+    head = (double) sample->samplerate * streamer->head_msec / 1000.0;
+    stream->head_end = (head < stream->end - sample->start) ? sample->start + (unsigned int) head : stream->end;
+  }
+  else {
+    stream->head_end = stream->end;
+  }
+
+  stream->loop_start = (sample->loopstart > sample->start + FLUID_STREAM_LOOP_GUARD)
+    ? sample->loopstart - FLUID_STREAM_LOOP_GUARD : sample->start;
+  stream->loop_end = (sample->loopend + FLUID_STREAM_LOOP_GUARD < stream->end)
+    ? sample->loopend + FLUID_STREAM_LOOP_GUARD : stream->end;
+  if (stream->loop_end < stream->loop_start) {
+    stream->loop_end = stream->loop_start;
+  }
+
+  stream->read_pos = stream->head_end;
+
+  fluid_hashtable_insert(streamer->streams, sample, stream);
+
+  if (streamer->on_demand) {
+    return FLUID_OK;
+  }
+
+  return fluid_sample_stream_load(streamer, stream);
+}
+
+static int
+fluid_sample_stream_compare(void* a, void* b)
+{
+  unsigned int start_a = ((fluid_sample_stream_t*) a)->sample->start;
+  unsigned int start_b = ((fluid_sample_stream_t*) b)->sample->start;
+
+  return (start_a > start_b) - (start_a < start_b);
+}
+
+static int
+fluid_sample_streamer_collect(void* key, void* value, void* data)
+{
+  fluid_list_t** list = (fluid_list_t**) data;
+
+  *list = fluid_list_prepend(*list, value);
+  return FALSE;
+}
+
+/*
+ * Start the streaming thread once all samples have been added.
+ */
+static int
+fluid_sample_streamer_start(fluid_sample_streamer_t* streamer)
+{
+  fluid_list_t *streams = NULL, *list;
+  fluid_sample_stream_t *stream, *next;
+  fluid_sample_t* sample;
+  unsigned int end = 0;
+  int ret = FLUID_OK;
+
+  /* Releasing the data of a sample must not release the data of another
+   * one, so samples sharing their data are read completely, stay in ram
+   * and aren't handled by the streamer */
+  fluid_hashtable_foreach(streamer->streams, fluid_sample_streamer_collect, &streams);
+  streams = fluid_list_sort(streams, fluid_sample_stream_compare);
+
+  for (list = streams; list; list = fluid_list_next(list)) {
+    stream = (fluid_sample_stream_t*) fluid_list_get(list);
+    next = (fluid_sample_stream_t*) fluid_list_get(fluid_list_next(list));
+    sample = stream->sample;
+
+    if ((sample->start >= end) && ((next == NULL) || (next->sample->start >= stream->end))) {
+      end = stream->end;
+      continue;
+    }
+
+    if (stream->end > end) {
+      end = stream->end;
+    }
+
+    if (fluid_sample_streamer_read(streamer, sample->start, stream->end) != FLUID_OK) {
+      FLUID_LOG(FLUID_ERR, "Failed to read the data of sample '%s'", sample->name);
+      ret = FLUID_FAILED;
+      break;
+    }
+    fluid_voice_optimize_sample(sample);
+    fluid_hashtable_remove(streamer->streams, sample);
+  }
+
+  delete_fluid_list(streams);
+  if (ret != FLUID_OK) {
+    return ret;
+  }
+
+  streamer->thread = new_fluid_thread("sample-streaming", fluid_sample_streamer_run, streamer, 0, FALSE);
+  if (streamer->thread == NULL) {
+    return FLUID_FAILED;
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * Queue an event for the thread. Must only be called from one thread at a
+ * time (usually with the synth API lock held).
+ */
+static void
+fluid_sample_streamer_queue(fluid_sample_streamer_t* streamer, int type, void* data)
+{
+  fluid_sample_stream_event_t* event;
+
+  event = fluid_ringbuffer_get_inptr(streamer->queue, 0);
+  if (event == NULL) {
+    /* The selection is counted by the caller, so the thread can find the
+     * samples of a lost select event itself */
+    if (type == FLUID_STREAM_SELECT) {
+      fluid_atomic_int_set(&streamer->rescan, TRUE);
+    }
+    else {
+      FLUID_LOG(FLUID_WARN, "Sample streaming queue full, samples may be cut off");
+    }
+    return;
+  }
+
+  event->type = type;
+  event->data = data;
+  fluid_ringbuffer_next_inptr(streamer->queue, 1);
+}
+
+/*
+ * Have the thread read the resident part of a sample a voice is about to
+ * play, if it isn't in ram yet, and the rest of it while the voice plays the
+ * head. The sample isn't released until fluid_sample_streamer_unpin() is
+ * called, once the voice holds a reference to it.
+ */
+static void
+fluid_sample_streamer_request(fluid_sample_streamer_t* streamer, fluid_sample_t* sample)
+{
+  fluid_sample_stream_t* stream = fluid_hashtable_lookup(streamer->streams, sample);
+
+  if (stream != NULL) {
+    fluid_atomic_int_inc(&stream->pending);
+  }
+
+  fluid_sample_streamer_queue(streamer, FLUID_STREAM_PLAY, sample);
+}
+
+/*
+ * Let the thread release a sample passed to fluid_sample_streamer_request()
+ * again once it isn't used anymore.
+ */
+static void
+fluid_sample_streamer_unpin(fluid_sample_streamer_t* streamer, fluid_sample_t* sample)
+{
+  fluid_sample_stream_t* stream = fluid_hashtable_lookup(streamer->streams, sample);
+
+  if (stream != NULL) {
+    fluid_atomic_int_add(&stream->pending, -1);
+  }
+}
+
+static void
+fluid_sample_stream_count_select(fluid_sample_stream_t* stream, void* data)
+{
+  fluid_atomic_int_add(&stream->selected, *(int*) data);
+}
+
+/*
+ * Have the thread load the samples of a preset loaded on demand when it is
+ * selected on a channel, and release them once it isn't anymore. The
+ * selections are counted here, with the synth API lock held, so that the
+ * counts stay balanced whatever the thread gets to see.
+ */
+static void
+fluid_sample_streamer_select(fluid_sample_streamer_t* streamer, fluid_defpreset_t* preset, int selected)
+{
+  int incr = selected ? 1 : -1;
+
+  fluid_sample_streamer_foreach_preset_stream(streamer, preset, fluid_sample_stream_count_select, &incr);
+
+  /* Unused samples are released by the thread on its own */
+  if (selected) {
+    fluid_sample_streamer_queue(streamer, FLUID_STREAM_SELECT, preset);
+  }
+}
+
+#else
+#define new_fluid_sample_streamer(_sfont, _fcbs)       NULL
+#define delete_fluid_sample_streamer(_streamer)
+#define fluid_sample_streamer_add(_streamer, _sample)  FLUID_OK
+#define fluid_sample_streamer_start(_streamer)         FLUID_OK
+#define fluid_sample_streamer_request(_streamer, _sample)
+#define fluid_sample_streamer_unpin(_streamer, _sample)
+#define fluid_sample_streamer_select(_streamer, _preset, _selected)
+#endif
+
+
+
+/***************************************************************
+ *
+ *                     SOUNDFONT INDEX CACHE
+ */
+
+/* The index of a SoundFont file (its parsed and fixed up preset,
+ * instrument and sample headers) and the noise floor amplitudes of its
+ * samples can be cached in a directory, so that loading the file again
+ * neither parses it nor scans the sample loops. A cache file is a flat
+ * image of the index, which is only used for a file of the same path,
+ * size and modification time on the same kind of machine. */
+
+#define FLUID_SFCACHE_MAGIC       "FLSFIDX"
+#define FLUID_SFCACHE_VERSION     1
+#define FLUID_SFCACHE_BYTE_ORDER  0x01020304
+
+/* the arrays of a cache file start at multiples of 8 bytes */
+#define FLUID_SFCACHE_ALIGN(_n)   (((_n) + 7) & ~((size_t) 7))
+
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int byte_order;
+  time_t modification_time;
+  unsigned int file_size;
+  unsigned int path_size;          /* the size of the path following the header */
+
+  SFVersion sf_version;
+  SFVersion romver;
+  unsigned int samplepos;
+  unsigned int samplesize;
+  unsigned int sample24pos;
+  unsigned int sample24size;
+
+  unsigned int preset_count;
+  unsigned int inst_count;
+  unsigned int zone_count;         /* the preset zones followed by the instrument zones */
+  unsigned int gen_count;
+  unsigned int mod_count;
+  unsigned int sample_count;
+} fluid_sfcache_header_t;
+
+typedef struct {
+  char name[21];
+  unsigned short prenum;
+  unsigned short bank;
+  unsigned int libr;
+  unsigned int genre;
+  unsigned int morph;
+  unsigned int zone;               /* the index of the first zone */
+  unsigned int zone_count;
+} fluid_sfcache_preset_t;
+
+typedef struct {
+  char name[21];
+  unsigned int zone;
+  unsigned int zone_count;
+} fluid_sfcache_inst_t;
+
+typedef struct {
+  unsigned int instsamp;           /* 1 + the index of the instrument or sample, 0 for none */
+  unsigned int gen;
+  unsigned int gen_count;
+  unsigned int mod;
+  unsigned int mod_count;
+} fluid_sfcache_zone_t;
+
+/*
+ * Get the size and modification time identifying a version of a file.
+ */
+static int
+fluid_sfcache_get_file_key(const char* filename, unsigned int* size, time_t* modification_time)
+{
+#if defined(WIN32) || defined(__OS2__)
+  return FLUID_FAILED;
+#else
+  struct stat buf;
+
+  if (stat(filename, &buf) == -1) {
+    return FLUID_FAILED;
+  }
+
+  *size = (unsigned int) buf.st_size;
+  *modification_time = buf.st_mtime;
+  return FLUID_OK;
+#endif
+}
+
+/*
+ * Get the name of the cache file of a SoundFont file, a hash of its path.
+ */
+static char*
+fluid_sfcache_get_path(const char* dir, const char* filename)
+{
+  unsigned int h1 = 2166136261u, h2 = 5381;
+  const unsigned char* c;
+  char* path;
+  size_t size;
+
+  for (c = (const unsigned char*) filename; *c; c++) {
+    h1 = (h1 ^ *c) * 16777619u;
+    h2 = h2 * 33 + *c;
+  }
+
+  size = FLUID_STRLEN(dir) + 24;
+  path = FLUID_MALLOC(size);
+  if (path == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+
+  FLUID_SNPRINTF(path, size, "%s/%08x%08x.sfidx", dir, h1, h2);
+  return path;
+}
+
+/*
+ * Count the zones, generators and modulators of the zones of a preset or
+ * instrument.
+ */
+static void
+fluid_sfcache_count_zones(fluid_list_t* zones, fluid_sfcache_header_t* header)
+{
+  SFZone* zone;
+
+  for (; zones; zones = fluid_list_next(zones)) {
+    zone = (SFZone*) fluid_list_get(zones);
+    header->zone_count++;
+    header->gen_count += fluid_list_size(zone->gen);
+    header->mod_count += fluid_list_size(zone->mod);
+  }
+}
+
+/* Write a block of data to a cache file */
+static int
+fluid_sfcache_write(FILE* file, const void* data, size_t size, size_t* offset)
+{
+  if (FLUID_FWRITE(data, size, 1, file) != 1) {
+    return FLUID_FAILED;
+  }
+
+  *offset += size;
+  return FLUID_OK;
+}
+
+/* Pad the end of an array so that the next one is aligned */
+static int
+fluid_sfcache_pad(FILE* file, size_t* offset)
+{
+  static const char padding[8] = { 0 };
+  size_t pad = FLUID_SFCACHE_ALIGN(*offset) - *offset;
+
+  if ((pad > 0) && (FLUID_FWRITE(padding, pad, 1, file) != 1)) {
+    return FLUID_FAILED;
+  }
+
+  *offset += pad;
+  return FLUID_OK;
+}
+
+static int
+fluid_sfcache_write_zones(FILE* file, fluid_list_t* zones, fluid_hashtable_t* index,
+                          unsigned int* gen, unsigned int* mod, size_t* offset)
+{
+  fluid_sfcache_zone_t cache_zone;
+  SFZone* zone;
+
+  for (; zones; zones = fluid_list_next(zones)) {
+    zone = (SFZone*) fluid_list_get(zones);
+
+    cache_zone.instsamp = (zone->instsamp != NULL)
+      ? FLUID_POINTER_TO_INT(fluid_hashtable_lookup(index, zone->instsamp)) : 0;
+    cache_zone.gen = *gen;
+    cache_zone.gen_count = fluid_list_size(zone->gen);
+    cache_zone.mod = *mod;
+    cache_zone.mod_count = fluid_list_size(zone->mod);
+
+    if (fluid_sfcache_write(file, &cache_zone, sizeof(cache_zone), offset) != FLUID_OK) {
+      return FLUID_FAILED;
+    }
+
+    *gen += cache_zone.gen_count;
+    *mod += cache_zone.mod_count;
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * Write the generators (or modulators) of a list of zones.
+ */
+static int
+fluid_sfcache_write_zone_items(FILE* file, fluid_list_t* zones, int mods, size_t* offset)
+{
+  fluid_list_t* item;
+  SFZone* zone;
+  void* data;
+  size_t size = mods ? sizeof(SFMod) : sizeof(SFGen);
+
+  for (; zones; zones = fluid_list_next(zones)) {
+    zone = (SFZone*) fluid_list_get(zones);
+
+    for (item = mods ? zone->mod : zone->gen; item; item = fluid_list_next(item)) {
+      data = fluid_list_get(item);
+      if ((data == NULL) || (FLUID_FWRITE(data, size, 1, file) != 1)) {
+        return FLUID_FAILED;
+      }
+      *offset += size;
+    }
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * Write the index of a loaded SoundFont file to the cache. The cache file
+ * is written under a temporary name and renamed, so that loading the file
+ * concurrently never sees a partial cache file.
+ */
+static void
+fluid_sfcache_save(const char* dir, const char* filename, SFData* sf)
+{
+  fluid_sfcache_header_t header;
+  fluid_sfcache_preset_t cache_preset;
+  fluid_sfcache_inst_t cache_inst;
+  fluid_hashtable_t* index = NULL;
+  fluid_list_t *p;
+  SFPreset* preset;
+  SFInst* inst;
+  SFSample sample;
+  FILE* file = NULL;
+  char *path, *tmp_path = NULL;
+  unsigned int zone = 0, gen = 0, mod = 0;
+  size_t offset = 0;
+  int mods, closed, ret = FLUID_FAILED;
+
+  FLUID_MEMSET(&header, 0, sizeof(header));
+  if (fluid_sfcache_get_file_key(filename, &header.file_size, &header.modification_time) != FLUID_OK) {
+    return;
+  }
+
+  path = fluid_sfcache_get_path(dir, filename);
+  if (path == NULL) {
+    return;
+  }
+
+  FLUID_MEMCPY(header.magic, FLUID_SFCACHE_MAGIC, sizeof(header.magic));
+  header.version = FLUID_SFCACHE_VERSION;
+  header.byte_order = FLUID_SFCACHE_BYTE_ORDER;
+  header.path_size = FLUID_STRLEN(filename) + 1;
+  header.sf_version = sf->version;
+  header.romver = sf->romver;
+  header.samplepos = sf->samplepos;
+  header.samplesize = sf->samplesize;
+  header.sample24pos = sf->sample24pos;
+  header.sample24size = sf->sample24size;
+
+  /* Map the instruments and samples referenced by the zones to their index */
+  index = new_fluid_hashtable(NULL, NULL);
+  if (index == NULL) {
+    goto exit;
+  }
+
+  for (p = sf->preset; p; p = fluid_list_next(p)) {
+    header.preset_count++;
+    fluid_sfcache_count_zones(((SFPreset*) fluid_list_get(p))->zone, &header);
+  }
+  for (p = sf->inst; p; p = fluid_list_next(p)) {
+    fluid_hashtable_insert(index, p, FLUID_INT_TO_POINTER(++header.inst_count));
+    fluid_sfcache_count_zones(((SFInst*) fluid_list_get(p))->zone, &header);
+  }
+  for (p = sf->sample; p; p = fluid_list_next(p)) {
+    fluid_hashtable_insert(index, p, FLUID_INT_TO_POINTER(++header.sample_count));
+  }
+
+  tmp_path = FLUID_MALLOC(FLUID_STRLEN(path) + 5);
+  if (tmp_path == NULL) {
+    goto exit;
+  }
+  FLUID_SNPRINTF(tmp_path, FLUID_STRLEN(path) + 5, "%s.tmp", path);
+
+  file = FLUID_FOPEN(tmp_path, "wb");
+  if (file == NULL) {
+    goto exit;
+  }
+
+  if ((fluid_sfcache_write(file, &header, sizeof(header), &offset) != FLUID_OK)
+      || (fluid_sfcache_pad(file, &offset) != FLUID_OK)
+      || (fluid_sfcache_write(file, filename, header.path_size, &offset) != FLUID_OK)
+      || (fluid_sfcache_pad(file, &offset) != FLUID_OK)) {
+    goto exit;
+  }
+
+  for (p = sf->preset; p; p = fluid_list_next(p)) {
+    preset = (SFPreset*) fluid_list_get(p);
+    FLUID_MEMSET(&cache_preset, 0, sizeof(cache_preset));
+    FLUID_MEMCPY(cache_preset.name, preset->name, sizeof(cache_preset.name));
+    cache_preset.prenum = preset->prenum;
+    cache_preset.bank = preset->bank;
+    cache_preset.libr = preset->libr;
+    cache_preset.genre = preset->genre;
+    cache_preset.morph = preset->morph;
+    cache_preset.zone = zone;
+    cache_preset.zone_count = fluid_list_size(preset->zone);
+    zone += cache_preset.zone_count;
+
+    if (fluid_sfcache_write(file, &cache_preset, sizeof(cache_preset), &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+  if (fluid_sfcache_pad(file, &offset) != FLUID_OK) {
+    goto exit;
+  }
+
+  for (p = sf->inst; p; p = fluid_list_next(p)) {
+    inst = (SFInst*) fluid_list_get(p);
+    FLUID_MEMSET(&cache_inst, 0, sizeof(cache_inst));
+    FLUID_MEMCPY(cache_inst.name, inst->name, sizeof(cache_inst.name));
+    cache_inst.zone = zone;
+    cache_inst.zone_count = fluid_list_size(inst->zone);
+    zone += cache_inst.zone_count;
+
+    if (fluid_sfcache_write(file, &cache_inst, sizeof(cache_inst), &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+  if (fluid_sfcache_pad(file, &offset) != FLUID_OK) {
+    goto exit;
+  }
+
+  for (p = sf->preset; p; p = fluid_list_next(p)) {
+    if (fluid_sfcache_write_zones(file, ((SFPreset*) fluid_list_get(p))->zone, index,
+                                  &gen, &mod, &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+  for (p = sf->inst; p; p = fluid_list_next(p)) {
+    if (fluid_sfcache_write_zones(file, ((SFInst*) fluid_list_get(p))->zone, index,
+                                  &gen, &mod, &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+  if (fluid_sfcache_pad(file, &offset) != FLUID_OK) {
+    goto exit;
+  }
+
+  /* The generators, then the modulators of all zones */
+  for (mods = FALSE; mods <= TRUE; mods++) {
+    for (p = sf->preset; p; p = fluid_list_next(p)) {
+      if (fluid_sfcache_write_zone_items(file, ((SFPreset*) fluid_list_get(p))->zone, mods, &offset) != FLUID_OK) {
+        goto exit;
+      }
+    }
+    for (p = sf->inst; p; p = fluid_list_next(p)) {
+      if (fluid_sfcache_write_zone_items(file, ((SFInst*) fluid_list_get(p))->zone, mods, &offset) != FLUID_OK) {
+        goto exit;
+      }
+    }
+    if (fluid_sfcache_pad(file, &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+
+  /* The sample headers, with the noise floor amplitudes found so far */
+  for (p = sf->sample; p; p = fluid_list_next(p)) {
+    sample = *(SFSample*) fluid_list_get(p);
+    if ((sample.fluid_sample != NULL) && sample.fluid_sample->amplitude_that_reaches_noise_floor_is_valid) {
+      sample.amplitude_that_reaches_noise_floor = sample.fluid_sample->amplitude_that_reaches_noise_floor;
+    }
+    sample.fluid_sample = NULL;
+
+    if (fluid_sfcache_write(file, &sample, sizeof(sample), &offset) != FLUID_OK) {
+      goto exit;
+    }
+  }
+
+  /* The stream is gone even if closing it fails */
+  closed = FLUID_FCLOSE(file);
+  file = NULL;
+  if ((closed == 0) && (rename(tmp_path, path) == 0)) {
+    ret = FLUID_OK;
+  }
+
+ exit:
+  if (file != NULL) {
+    FLUID_FCLOSE(file);
+  }
+  if (ret != FLUID_OK) {
+    FLUID_LOG(FLUID_WARN, "Failed to write the SoundFont index cache file '%s'", path);
+    if (tmp_path != NULL) {
+      remove(tmp_path);
+    }
+  }
+
+  if (index != NULL) {
+    delete_fluid_hashtable(index);
+  }
+  FLUID_FREE(tmp_path);
+  FLUID_FREE(path);
+}
+
+/*
+ * Append an item to a list being built, last being its last node.
+ */
+static int
+fluid_sfcache_append(fluid_list_t** list, fluid_list_t** last, void* data)
+{
+  fluid_list_t* node;
+
+  if ((data == NULL) || ((node = new_fluid_list()) == NULL)) {
+    FLUID_FREE(data);
+    return FLUID_FAILED;
+  }
+
+  node->data = data;
+  if (*last != NULL) {
+    (*last)->next = node;
+  }
+  else {
+    *list = node;
+  }
+  *last = node;
+  return FLUID_OK;
+}
+
+/*
+ * Rebuild the zones first to first + count - 1 of a preset or instrument.
+ */
+static int
+fluid_sfcache_load_zones(fluid_list_t** zones, const fluid_sfcache_zone_t* cache_zones,
+                         unsigned int first, unsigned int count, fluid_list_t** instsamp,
+                         const SFGen* gens, const SFMod* mods)
+{
+  const fluid_sfcache_zone_t* cache_zone;
+  fluid_list_t *last = NULL, *last_item;
+  SFZone* zone;
+  unsigned int i;
+
+  for (cache_zone = cache_zones + first; cache_zone < cache_zones + first + count; cache_zone++) {
+    zone = FLUID_NEW(SFZone);
+    if (zone != NULL) {
+      FLUID_MEMSET(zone, 0, sizeof(*zone));
+    }
+    if (fluid_sfcache_append(zones, &last, zone) != FLUID_OK) {
+      return FLUID_FAILED;
+    }
+
+    zone->instsamp = (cache_zone->instsamp > 0) ? instsamp[cache_zone->instsamp - 1] : NULL;
+
+    last_item = NULL;
+    for (i = cache_zone->gen; i < cache_zone->gen + cache_zone->gen_count; i++) {
+      SFGen* gen = FLUID_NEW(SFGen);
+      if (gen != NULL) {
+        *gen = gens[i];
+      }
+      if (fluid_sfcache_append(&zone->gen, &last_item, gen) != FLUID_OK) {
+        return FLUID_FAILED;
+      }
+    }
+
+    last_item = NULL;
+    for (i = cache_zone->mod; i < cache_zone->mod + cache_zone->mod_count; i++) {
+      SFMod* mod = FLUID_NEW(SFMod);
+      if (mod != NULL) {
+        *mod = mods[i];
+      }
+      if (fluid_sfcache_append(&zone->mod, &last_item, mod) != FLUID_OK) {
+        return FLUID_FAILED;
+      }
+    }
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * Check that the zones first to first + count - 1 and what they reference
+ * lie within the cache file.
+ */
+static int
+fluid_sfcache_check_zones(const fluid_sfcache_header_t* header, const fluid_sfcache_zone_t* zones,
+                          unsigned int first, unsigned int count, unsigned int instsamp_count)
+{
+  unsigned int i;
+
+  if ((first > header->zone_count) || (count > header->zone_count - first)) {
+    return FLUID_FAILED;
+  }
+
+  for (i = first; i < first + count; i++) {
+    if ((zones[i].instsamp > instsamp_count)
+        || (zones[i].gen > header->gen_count) || (zones[i].gen_count > header->gen_count - zones[i].gen)
+        || (zones[i].mod > header->mod_count) || (zones[i].mod_count > header->mod_count - zones[i].mod)) {
+      return FLUID_FAILED;
+    }
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * Load the index of a SoundFont file from the cache. Returns NULL if the
+ * file isn't cached or the cache file doesn't match it.
+ */
+static SFData*
+fluid_sfcache_load(const char* dir, const char* filename, const fluid_file_callbacks_t* fcbs)
+{
+  const fluid_sfcache_header_t* header = NULL;
+  const fluid_sfcache_preset_t* cache_presets;
+  const fluid_sfcache_inst_t* cache_insts;
+  const fluid_sfcache_zone_t* cache_zones;
+  const SFGen* gens;
+  const SFMod* mods;
+  const SFSample* samples;
+  fluid_list_t **inst_nodes = NULL, **sample_nodes = NULL, *last;
+  SFData* sf = NULL;
+  SFPreset* preset;
+  SFInst* inst;
+  SFSample* sample;
+  char *path, *data = NULL;
+  FILE* file;
+  long size = 0;
+  size_t offset;
+  unsigned int file_size, i;
+  time_t modification_time;
+  int ret = FLUID_FAILED;
+
+  if (fluid_sfcache_get_file_key(filename, &file_size, &modification_time) != FLUID_OK) {
+    return NULL;
+  }
+
+  path = fluid_sfcache_get_path(dir, filename);
+  if (path == NULL) {
+    return NULL;
+  }
+
+  file = FLUID_FOPEN(path, "rb");
+  FLUID_FREE(path);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  if ((FLUID_FSEEK(file, 0, SEEK_END) == 0) && ((size = FLUID_FTELL(file)) >= (long) sizeof(*header))
+      && (FLUID_FSEEK(file, 0, SEEK_SET) == 0) && ((data = FLUID_MALLOC(size)) != NULL)
+      && (FLUID_FREAD(data, size, 1, file) != 1)) {
+    FLUID_FREE(data);
+    data = NULL;
+  }
+  FLUID_FCLOSE(file);
+
+  if (data == NULL) {
+    return NULL;
+  }
+
+  /* Check that the cache file belongs to this version of the file, and
+   * that all of its arrays are there */
+  header = (const fluid_sfcache_header_t*) data;
+  if ((FLUID_MEMCMP(header->magic, FLUID_SFCACHE_MAGIC, sizeof(header->magic)) != 0)
+      || (header->version != FLUID_SFCACHE_VERSION) || (header->byte_order != FLUID_SFCACHE_BYTE_ORDER)
+      || (header->file_size != file_size) || (header->modification_time != modification_time)
+      || (header->path_size != FLUID_STRLEN(filename) + 1)
+      || (header->path_size > (size_t) size - sizeof(*header))
+      || (FLUID_MEMCMP(data + sizeof(*header), filename, header->path_size) != 0)) {
+    goto outdated;
+  }
+
+  offset = FLUID_SFCACHE_ALIGN(sizeof(*header)) + FLUID_SFCACHE_ALIGN(header->path_size);
+  cache_presets = (const fluid_sfcache_preset_t*) (data + offset);
+  offset += FLUID_SFCACHE_ALIGN(header->preset_count * sizeof(*cache_presets));
+  cache_insts = (const fluid_sfcache_inst_t*) (data + offset);
+  offset += FLUID_SFCACHE_ALIGN(header->inst_count * sizeof(*cache_insts));
+  cache_zones = (const fluid_sfcache_zone_t*) (data + offset);
+  offset += FLUID_SFCACHE_ALIGN(header->zone_count * sizeof(*cache_zones));
+  gens = (const SFGen*) (data + offset);
+  offset += FLUID_SFCACHE_ALIGN(header->gen_count * sizeof(*gens));
+  mods = (const SFMod*) (data + offset);
+  offset += FLUID_SFCACHE_ALIGN(header->mod_count * sizeof(*mods));
+  samples = (const SFSample*) (data + offset);
+  offset += header->sample_count * sizeof(*samples);
+
+  if ((header->preset_count > (unsigned int) size) || (header->inst_count > (unsigned int) size)
+      || (header->zone_count > (unsigned int) size) || (header->gen_count > (unsigned int) size)
+      || (header->mod_count > (unsigned int) size) || (header->sample_count > (unsigned int) size)
+      || (offset > (size_t) size)) {
+    goto outdated;
+  }
+
+  for (i = 0; i < header->preset_count; i++) {
+    if (fluid_sfcache_check_zones(header, cache_zones, cache_presets[i].zone, cache_presets[i].zone_count,
+                                  header->inst_count) != FLUID_OK) {
+      goto outdated;
+    }
+  }
+  for (i = 0; i < header->inst_count; i++) {
+    if (fluid_sfcache_check_zones(header, cache_zones, cache_insts[i].zone, cache_insts[i].zone_count,
+                                  header->sample_count) != FLUID_OK) {
+      goto outdated;
+    }
+  }
+
+  for (i = 0; i < header->gen_count; i++) {
+    if (gens[i].id >= GEN_LAST) {
+      goto outdated;
+    }
+  }
+
+  /* Rebuild the index */
+  sf = FLUID_NEW(SFData);
+  inst_nodes = FLUID_ARRAY(fluid_list_t*, header->inst_count + 1);
+  sample_nodes = FLUID_ARRAY(fluid_list_t*, header->sample_count + 1);
+  if ((sf == NULL) || (inst_nodes == NULL) || (sample_nodes == NULL)) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(sf);
+    sf = NULL;
+    goto exit;
+  }
+
+  FLUID_MEMSET(sf, 0, sizeof(*sf));
+  sf->version = header->sf_version;
+  sf->romver = header->romver;
+  sf->samplepos = header->samplepos;
+  sf->samplesize = header->samplesize;
+  sf->sample24pos = header->sample24pos;
+  sf->sample24size = header->sample24size;
+
+  for (i = 0, last = NULL; i < header->sample_count; i++) {
+    sample = FLUID_NEW(SFSample);
+    if (sample != NULL) {
+      *sample = samples[i];
+    }
+    if (fluid_sfcache_append(&sf->sample, &last, sample) != FLUID_OK) {
+      goto exit;
+    }
+    sample_nodes[i] = last;
+  }
+
+  for (i = 0, last = NULL; i < header->inst_count; i++) {
+    inst = FLUID_NEW(SFInst);
+    if (inst != NULL) {
+      FLUID_MEMSET(inst, 0, sizeof(*inst));
+      FLUID_MEMCPY(inst->name, cache_insts[i].name, sizeof(inst->name) - 1);
+    }
+    if (fluid_sfcache_append(&sf->inst, &last, inst) != FLUID_OK) {
+      goto exit;
+    }
+    inst_nodes[i] = last;
+
+    if (fluid_sfcache_load_zones(&inst->zone, cache_zones, cache_insts[i].zone, cache_insts[i].zone_count,
+                                 sample_nodes, gens, mods) != FLUID_OK) {
+      goto exit;
+    }
+  }
+
+  for (i = 0, last = NULL; i < header->preset_count; i++) {
+    preset = FLUID_NEW(SFPreset);
+    if (preset != NULL) {
+      FLUID_MEMSET(preset, 0, sizeof(*preset));
+      FLUID_MEMCPY(preset->name, cache_presets[i].name, sizeof(preset->name) - 1);
+      preset->prenum = cache_presets[i].prenum;
+      preset->bank = cache_presets[i].bank;
+      preset->libr = cache_presets[i].libr;
+      preset->genre = cache_presets[i].genre;
+      preset->morph = cache_presets[i].morph;
+    }
+    if (fluid_sfcache_append(&sf->preset, &last, preset) != FLUID_OK) {
+      goto exit;
+    }
+
+    if (fluid_sfcache_load_zones(&preset->zone, cache_zones, cache_presets[i].zone, cache_presets[i].zone_count,
+                                 inst_nodes, gens, mods) != FLUID_OK) {
+      goto exit;
+    }
+  }
+
+  ret = FLUID_OK;
+
+ outdated:
+  if (ret != FLUID_OK && sf == NULL) {
+    FLUID_LOG(FLUID_DBG, "Ignoring the outdated SoundFont index cache file of '%s'", filename);
+  }
+
+ exit:
+  if ((ret != FLUID_OK) && (sf != NULL)) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    sfont_close(sf, fcbs);
+    sf = NULL;
+  }
+
+  FLUID_FREE(inst_nodes);
+  FLUID_FREE(sample_nodes);
+  FLUID_FREE(data);
+  return sf;
+}
+
+
+
+/***************************************************************
+ *
+ *                           SFONT
+ */
+
+/*
+ * new_fluid_defsfont
+ */
+fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
+{
+  fluid_defsfont_t* sfont;
+  int i;
+
+  sfont = FLUID_NEW(fluid_defsfont_t);
+  if (sfont == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+
+  FLUID_MEMSET(sfont, 0, sizeof(*sfont));
+  
+  fluid_settings_getint(settings, "synth.lock-memory", &sfont->mlock);
+  fluid_settings_getint(settings, "synth.sample-mmap", &sfont->mmap);
+  fluid_settings_getint(settings, "synth.sample-streaming", &sfont->stream_head);
+  fluid_settings_getint(settings, "synth.dynamic-sample-loading", &sfont->dynamic_loading);
+  fluid_settings_getint(settings, "synth.sample-unload-delay", &sfont->unload_delay);
+  fluid_settings_getint(settings, "synth.cpu-cores", &sfont->load_threads);
+
+  if ((fluid_settings_dupstr(settings, "synth.soundfont-cache-dir", &sfont->cache_dir) != FLUID_OK)
+      || ((sfont->cache_dir != NULL) && (sfont->cache_dir[0] == '\0'))) {
+    FLUID_FREE(sfont->cache_dir);
+    sfont->cache_dir = NULL;
+  }
+
+  /* Initialise preset cache, so we don't have to call malloc on program changes.
+     Usually, we have at most one preset per channel plus one temporarily used,
+     so optimise for that case. */
+  fluid_settings_getint(settings, "synth.midi-channels", &sfont->preset_stack_capacity);
+  sfont->preset_stack_capacity++;
+  
+  sfont->preset_stack = FLUID_ARRAY(fluid_preset_t*, sfont->preset_stack_capacity);
+  if (!sfont->preset_stack) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(sfont->cache_dir);
+    FLUID_FREE(sfont);
+    return NULL;
+  }
+
+  for (i = 0; i < sfont->preset_stack_capacity; i++) {
+    sfont->preset_stack[i] = FLUID_NEW(fluid_preset_t);
+    if (!sfont->preset_stack[i]) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      delete_fluid_defsfont(sfont);
+      return NULL;
+    }
+    sfont->preset_stack_size++;
+  }
+
+  sfont->preset_index = new_fluid_hashtable(NULL, NULL);
+  if (sfont->preset_index == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    delete_fluid_defsfont(sfont);
+    return NULL;
+  }
+
+  return sfont;
+}
+
+/*
+ * delete_fluid_defsfont
+ */
+int delete_fluid_defsfont(fluid_defsfont_t* sfont)
+{
+  fluid_list_t *list;
+  fluid_defpreset_t* preset;
+  fluid_sample_t* sample;
+
+  fluid_return_val_if_fail(sfont != NULL, FLUID_OK);
+  
+  /* Check that no samples are currently used */
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    sample = (fluid_sample_t*) fluid_list_get(list);
+    if (sample->refcount != 0) {
+      return FLUID_FAILED;
+    }
+  }
+
+  /* The streaming thread must be stopped before the samples are deleted */
+  if (sfont->streamer != NULL) {
+    delete_fluid_sample_streamer(sfont->streamer);
+  }
+  else if (sfont->sampledata != NULL) {
+    fluid_cached_sampledata_unload(sfont->sampledata);
+  }
+
+  if (sfont->filename != NULL) {
+    FLUID_FREE(sfont->filename);
+  }
+  FLUID_FREE(sfont->cache_dir);
+
+  for (list = sfont->sample; list; list = fluid_list_next(list)) {
+    delete_fluid_sample((fluid_sample_t*) fluid_list_get(list));
+  }
+
+  if (sfont->sample) {
+    delete_fluid_list(sfont->sample);
+  }
+
+  while (sfont->preset_stack_size > 0)
+    FLUID_FREE(sfont->preset_stack[--sfont->preset_stack_size]);
+  FLUID_FREE(sfont->preset_stack);
+
+  if (sfont->preset_index != NULL) {
+    delete_fluid_hashtable(sfont->preset_index);
+  }
+
+  preset = sfont->preset;
+  while (preset != NULL) {
+    sfont->preset = preset->next;
+    delete_fluid_defpreset(preset);
+    preset = sfont->preset;
+  }
+
+  FLUID_FREE(sfont);
+  return FLUID_OK;
+}
+
+/*
+ * fluid_defsfont_get_name
+ */
+const char* fluid_defsfont_get_name(fluid_defsfont_t* sfont)
+{
+  return sfont->filename;
+}
+
+
+/*
+ * The sample data of a SoundFont file is read by a thread of its own
+ * while the headers of its samples and its presets are imported, then the
+ * samples are imported from it by all the loading threads.
+ */
+typedef struct {
+  fluid_defsfont_t* sfont;
+  const fluid_file_callbacks_t* fcbs;
+  fluid_sample_t** samples;
+  int sample_count;
+  int next;                  /* the index of the next sample to import */
+  int status;                /* FLUID_FAILED once reading or importing failed */
+  short* sampledata;         /* the sample data read in the background */
+  char* sample24data;
+} fluid_defsfont_loader_t;
+
+static fluid_thread_return_t
+fluid_defsfont_read_sampledata(void* data)
+{
+  fluid_defsfont_loader_t* loader = (fluid_defsfont_loader_t*) data;
+  fluid_defsfont_t* sfont = loader->sfont;
+
+  /* The sample headers are imported meanwhile, the data is handed over
+     to the SoundFont once this thread has been joined */
+  if (fluid_cached_sampledata_load(sfont->filename,
+                                   sfont->samplepos, sfont->samplesize, &loader->sampledata,
+                                   sfont->sample24pos, sfont->sample24size, &loader->sample24data,
+                                   sfont->mlock, sfont->mmap,
+                                   loader->fcbs) != FLUID_OK) {
+    fluid_atomic_int_set(&loader->status, FLUID_FAILED);
+  }
+
+  return FLUID_THREAD_RETURN_VALUE;
+}
+
+static fluid_thread_return_t
+fluid_defsfont_import_sampledata(void* data)
+{
+  fluid_defsfont_loader_t* loader = (fluid_defsfont_loader_t*) data;
+  int i;
+
+  while ((i = fluid_atomic_int_exchange_and_add(&loader->next, 1)) < loader->sample_count) {
+    if (fluid_sample_import_sfont_data(loader->samples[i], loader->sfont) != FLUID_OK) {
+      fluid_atomic_int_set(&loader->status, FLUID_FAILED);
+    }
   }
 
-  FLUID_FREE(sfont);
-  return FLUID_OK;
+  return FLUID_THREAD_RETURN_VALUE;
 }
 
 /*
- * fluid_defsfont_get_name
+ * Import the data of all samples, using the loading threads.
  */
-const char* fluid_defsfont_get_name(fluid_defsfont_t* sfont)
+static int
+fluid_defsfont_import_samples(fluid_defsfont_t* sfont, fluid_defsfont_loader_t* loader)
 {
-  return sfont->filename;
-}
+  fluid_thread_t** threads;
+  fluid_list_t* p;
+  int i, count = 0;
+
+  loader->sample_count = fluid_list_size(sfont->sample);
+  loader->samples = FLUID_ARRAY(fluid_sample_t*, loader->sample_count + 1);
+  threads = FLUID_ARRAY(fluid_thread_t*, sfont->load_threads);
+  if ((loader->samples == NULL) || (threads == NULL)) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(loader->samples);
+    FLUID_FREE(threads);
+    return FLUID_FAILED;
+  }
+
+  for (i = 0, p = sfont->sample; p; i++, p = fluid_list_next(p)) {
+    loader->samples[i] = (fluid_sample_t*) fluid_list_get(p);
+  }
+
+  /* This thread imports samples too */
+  for (i = 1; i < sfont->load_threads; i++) {
+    threads[count] = new_fluid_thread("sfload", fluid_defsfont_import_sampledata, loader, 0, FALSE);
+    if (threads[count] == NULL) {
+      break;
+    }
+    count++;
+  }
+
+  fluid_defsfont_import_sampledata(loader);
+
+  for (i = 0; i < count; i++) {
+    fluid_thread_join(threads[i]);
+    delete_fluid_thread(threads[i]);
+  }
 
+  FLUID_FREE(threads);
+  FLUID_FREE(loader->samples);
+  loader->samples = NULL;
+  return fluid_atomic_int_get(&loader->status);
+}
 
 /*
  * fluid_defsfont_load
@@ -592,6 +2214,14 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* f
   SFSample* sfsample;
   fluid_sample_t* sample;
   fluid_defpreset_t* preset = NULL;
+  fluid_defsfont_loader_t loader;
+  fluid_thread_t* reader = NULL;
+  int use_cache, cached;
+
+  FLUID_MEMSET(&loader, 0, sizeof(loader));
+  loader.sfont = sfont;
+  loader.fcbs = fcbs;
+  loader.status = FLUID_OK;
 
   sfont->filename = FLUID_MALLOC(1 + FLUID_STRLEN(file));
   if (sfont->filename == NULL) {
@@ -600,8 +2230,15 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* f
   }
   FLUID_STRCPY(sfont->filename, file);
 
-  /* The actual loading is done in the sfont and sffile files */
-  sfdata = sfload_file(file, fcbs);
+  /* Use the cached index of files read from the file system if there is
+     one, the actual loading is done in the sfont and sffile files */
+  use_cache = (sfont->cache_dir != NULL) && (fcbs->fopen == default_fopen);
+  sfdata = use_cache ? fluid_sfcache_load(sfont->cache_dir, file, fcbs) : NULL;
+  cached = (sfdata != NULL);
+
+  if (sfdata == NULL) {
+    sfdata = sfload_file(file, fcbs);
+  }
   if (sfdata == NULL) {
     FLUID_LOG(FLUID_ERR, "Couldn't load soundfont file");
     return FLUID_FAILED;
@@ -614,9 +2251,24 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* f
   sfont->sample24pos = sfdata->sample24pos;
   sfont->sample24size = sfdata->sample24size;
 
-  /* load sample data in one block */
-  if (fluid_defsfont_load_sampledata(sfont, fcbs) != FLUID_OK)
-    goto err_exit;
+  /* Stream the sample data or load it on demand if requested, except for
+     compressed samples which are decoded at load time */
+  if (((sfont->stream_head > 0) || sfont->dynamic_loading) && (sfdata->version.major == 2)) {
+    sfont->streamer = new_fluid_sample_streamer(sfont, fcbs);
+    if (sfont->streamer == NULL)
+      FLUID_LOG(FLUID_WARN, "Failed to set up streaming of the sample data, loading it instead.");
+  }
+
+  /* load sample data in one block, in the background if there are
+     several loading threads */
+  if (sfont->streamer == NULL) {
+    sfont->dynamic_loading = FALSE;
+    if (sfont->load_threads > 1) {
+      reader = new_fluid_thread("sfload", fluid_defsfont_read_sampledata, &loader, 0, FALSE);
+    }
+    if ((reader == NULL) && (fluid_defsfont_load_sampledata(sfont, fcbs) != FLUID_OK))
+      goto err_exit;
+  }
 
   /* Create all the sample headers */
   p = sfdata->sample;
@@ -629,11 +2281,24 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* f
     if (fluid_sample_import_sfont(sample, sfsample, sfont) != FLUID_OK)
       goto err_exit;
 
+    /* The noise floor amplitude found when the index was cached saves
+       scanning the loop again */
+    if (sfsample->amplitude_that_reaches_noise_floor > 0) {
+      sample->amplitude_that_reaches_noise_floor = sfsample->amplitude_that_reaches_noise_floor;
+      sample->amplitude_that_reaches_noise_floor_is_valid = TRUE;
+    }
+
     /* Store reference to FluidSynth sample in SFSample for later IZone fixups */
     sfsample->fluid_sample = sample;
 
     fluid_defsfont_add_sample(sfont, sample);
-    fluid_voice_optimize_sample(sample);
+
+    /* The streamer optimizes the samples once their data has been read,
+       otherwise they are imported once it's loaded */
+    if (sfont->streamer != NULL) {
+      if (fluid_sample_streamer_add(sfont->streamer, sample) != FLUID_OK)
+        goto err_exit;
+    }
     p = fluid_list_next(p);
   }
 
@@ -650,11 +2315,40 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const fluid_file_callbacks_t* f
     fluid_defsfont_add_preset(sfont, preset);
     p = fluid_list_next(p);
   }
+  preset = NULL;
+
+  if (sfont->streamer != NULL) {
+    if (fluid_sample_streamer_start(sfont->streamer) != FLUID_OK)
+      goto err_exit;
+  }
+  else {
+    if (reader != NULL) {
+      fluid_thread_join(reader);
+      delete_fluid_thread(reader);
+      reader = NULL;
+      sfont->sampledata = loader.sampledata;
+      sfont->sample24data = loader.sample24data;
+    }
+    if ((fluid_atomic_int_get(&loader.status) != FLUID_OK)
+        || (fluid_defsfont_import_samples(sfont, &loader) != FLUID_OK))
+      goto err_exit;
+  }
+
+  if (use_cache && !cached) {
+    fluid_sfcache_save(sfont->cache_dir, file, sfdata);
+  }
+
   sfont_close (sfdata, fcbs);
 
   return FLUID_OK;
 
 err_exit:
+  if (reader != NULL) {
+    fluid_thread_join(reader);
+    delete_fluid_thread(reader);
+    sfont->sampledata = loader.sampledata;
+    sfont->sample24data = loader.sample24data;
+  }
   sfont_close (sfdata, fcbs);
   delete_fluid_defpreset(preset);
   return FLUID_FAILED;
@@ -670,6 +2364,9 @@ int fluid_defsfont_add_sample(fluid_defsfont_t* sfont, fluid_sample_t* sample)
   return FLUID_OK;
 }
 
+/* The key of a preset in the preset index of a SoundFont */
+#define FLUID_PRESET_INDEX_KEY(_bank, _num)  ((int) (((_bank) << 16) | (_num)))
+
 /* fluid_defsfont_add_preset
  *
  * Add a preset to the SoundFont
@@ -677,6 +2374,14 @@ int fluid_defsfont_add_sample(fluid_defsfont_t* sfont, fluid_sample_t* sample)
 int fluid_defsfont_add_preset(fluid_defsfont_t* sfont, fluid_defpreset_t* preset)
 {
   fluid_defpreset_t *cur, *prev;
+  void* key = FLUID_INT_TO_POINTER(FLUID_PRESET_INDEX_KEY(preset->bank, preset->num));
+
+  /* Index the preset, the first one of a bank and program number wins
+     like in the sorted list */
+  if (fluid_hashtable_lookup(sfont->preset_index, key) == NULL) {
+    fluid_hashtable_insert(sfont->preset_index, key, preset);
+  }
+
   if (sfont->preset == NULL) {
     preset->next = NULL;
     sfont->preset = preset;
@@ -714,7 +2419,7 @@ fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont, const fluid_file_callbac
   return fluid_cached_sampledata_load(sfont->filename,
                                       sfont->samplepos, sfont->samplesize, &sfont->sampledata,
                                       sfont->sample24pos, sfont->sample24size, &sfont->sample24data,
-                                      sfont->mlock,
+                                      sfont->mlock, sfont->mmap,
                                       fcbs);
 }
 
@@ -723,14 +2428,13 @@ fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont, const fluid_file_callbac
  */
 fluid_defpreset_t* fluid_defsfont_get_preset(fluid_defsfont_t* sfont, unsigned int bank, unsigned int num)
 {
-  fluid_defpreset_t* preset = sfont->preset;
-  while (preset != NULL) {
-    if ((preset->bank == bank) && ((preset->num == num))) {
-      return preset;
-    }
-    preset = preset->next;
+  /* SoundFont bank and program numbers are 16 bit words */
+  if ((bank > 0xffff) || (num > 0xffff)) {
+    return NULL;
   }
-  return NULL;
+
+  return fluid_hashtable_lookup(sfont->preset_index,
+                                FLUID_INT_TO_POINTER(FLUID_PRESET_INDEX_KEY(bank, num)));
 }
 
 /*
@@ -778,6 +2482,7 @@ new_fluid_defpreset(fluid_defsfont_t* sfont)
   preset->num = 0;
   preset->global_zone = NULL;
   preset->zone = NULL;
+  preset->zone_map = NULL;
   return preset;
 }
 
@@ -791,6 +2496,7 @@ delete_fluid_defpreset(fluid_defpreset_t* preset)
   
   fluid_return_if_fail(preset != NULL);
   
+    delete_fluid_zone_map(preset->zone_map);
     delete_fluid_preset_zone(preset->global_zone);
     preset->global_zone = NULL;
   
@@ -837,222 +2543,519 @@ fluid_defpreset_next(fluid_defpreset_t* preset)
 int
 fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan, int key, int vel)
 {
-  fluid_preset_zone_t *preset_zone, *global_preset_zone;
-  fluid_inst_t* inst;
-  fluid_inst_zone_t *inst_zone, *global_inst_zone;
-  fluid_sample_t* sample;
+  fluid_zone_pair_t* pair;
   fluid_voice_t* voice;
+  int i, n, list;
+  fluid_zone_map_t* map;
+
+  if ((key < 0) || (key > 127) || (vel < 0) || (vel > 127)) {
+    return FLUID_OK;
+  }
+
+  if (preset->zone_map == NULL) {
+    preset->zone_map = new_fluid_zone_map(preset);
+    if (preset->zone_map == NULL) {
+      return FLUID_FAILED;
+    }
+  }
+  map = preset->zone_map;
+
+  /* run thru all the zone pairs that play this key and velocity */
+  list = map->cell[key * map->vel_buckets + map->vel_bucket[vel]];
+  for (n = map->list_start[list]; n < map->list_start[list + 1]; n++) {
+
+    pair = &map->pairs[map->lists[n]];
+
+    /* check if the instrument zone is ignored. The map only holds zones
+       the note falls into, but an instrument zone must be ignored when its
+       voice is already running played by a legato passage (see
+       fluid_synth_noteon_monopoly_legato()) */
+    if (!fluid_zone_inside_range(&pair->inst_zone->range, key, vel)) {
+      continue;
+    }
+
+    /* have the sample data loaded if it isn't yet, or the rest of it read
+       while the voice plays its head */
+    if (preset->sfont->streamer != NULL) {
+      fluid_sample_streamer_request(preset->sfont->streamer, fluid_inst_zone_get_sample(pair->inst_zone));
+    }
+
+    /* this is a good zone. allocate a new synthesis process and initialize it */
+    voice = fluid_synth_alloc_voice_LOCAL(synth, fluid_inst_zone_get_sample(pair->inst_zone),
+                                          chan, key, vel, &pair->inst_zone->range);
+
+    /* the voice holds a reference to the sample now, which keeps it loaded */
+    if (preset->sfont->streamer != NULL) {
+      fluid_sample_streamer_unpin(preset->sfont->streamer, fluid_inst_zone_get_sample(pair->inst_zone));
+    }
+
+    if (voice == NULL) {
+      return FLUID_FAILED;
+    }
+
+    /* Instrument generators supersede the defaults, preset generators are
+     * added to them (see fluid_zone_pair_merge()) */
+    for (i = 0; i < pair->inst_gen_count; i++) {
+      fluid_voice_gen_set(voice, pair->gens[i].num, pair->gens[i].val);
+    }
+    for (; i < pair->gen_count; i++) {
+      fluid_voice_gen_incr(voice, pair->gens[i].num, pair->gens[i].val);
+    }
+
+    /* Instrument modulators -supersede- existing (default) modulators,
+     * preset modulators -add- to existing instrument / default modulators */
+    for (i = 0; i < pair->inst_mod_count; i++) {
+      fluid_voice_add_mod(voice, pair->mods[i], FLUID_VOICE_OVERWRITE);
+    }
+    for (; i < pair->mod_count; i++) {
+      fluid_voice_add_mod(voice, pair->mods[i], FLUID_VOICE_ADD);
+    }
+
+    /* add the synthesis process to the synthesis loop. */
+    fluid_synth_start_voice(synth, voice);
+
+    /* Store the ID of the first voice that was created by this noteon event.
+     * Exclusive class may only terminate older voices.
+     * That avoids killing voices, which have just been created.
+     * (a noteon event can create several voice processes with the same exclusive
+     * class - for example when using stereo samples)
+     */
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * fluid_defpreset_preset_notify
+ *
+ * Have the sample data of a preset loaded when it is selected on a channel
+ * if it is loaded on demand.
+ */
+int
+fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan)
+{
+  fluid_defpreset_t* defpreset = fluid_preset_get_data(preset);
+  fluid_defsfont_t* sfont = defpreset->sfont;
+
+  if ((sfont->streamer != NULL) && sfont->dynamic_loading
+      && ((reason == FLUID_PRESET_SELECTED) || (reason == FLUID_PRESET_UNSELECTED))) {
+    fluid_sample_streamer_select(sfont->streamer, defpreset, reason == FLUID_PRESET_SELECTED);
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * fluid_zone_pair_merge
+ *
+ * Resolve which generators and modulators of the local and global preset
+ * and instrument zones a voice of the zone pair gets. Returns FLUID_OK or
+ * FLUID_FAILED if out of memory.
+ */
+static int
+fluid_zone_pair_merge(fluid_zone_pair_t* pair, fluid_preset_zone_t* global_preset_zone)
+{
+  fluid_preset_zone_t* preset_zone = pair->preset_zone;
+  fluid_inst_zone_t* inst_zone = pair->inst_zone;
+  fluid_inst_zone_t* global_inst_zone;
+  fluid_zone_gen_t gens[2 * GEN_LAST];
   fluid_mod_t * mod;
   fluid_mod_t * mod_list[FLUID_NUM_MOD]; /* list for 'sorting' preset modulators */
+  fluid_mod_t * mods[2 * FLUID_NUM_MOD];
   int mod_list_count;
+  int gen_count, mod_count;
   int i;
 
-  global_preset_zone = fluid_defpreset_get_global_zone(preset);
+  global_inst_zone = fluid_inst_get_global_zone(fluid_preset_zone_get_inst(preset_zone));
+  gen_count = 0;
+  mod_count = 0;
 
-  /* run thru all the zones of this preset */
-  preset_zone = fluid_defpreset_get_zone(preset);
-  while (preset_zone != NULL) {
+  /* Instrument level, generators */
 
-    /* check if the note falls into the key and velocity range of this
-       preset */
-    if (fluid_zone_inside_range(&preset_zone->range, key, vel)) {
+  for (i = 0; i < GEN_LAST; i++) {
 
-      inst = fluid_preset_zone_get_inst(preset_zone);
-      global_inst_zone = fluid_inst_get_global_zone(inst);
+    /* SF 2.01 section 9.4 'bullet' 4:
+     *
+     * A generator in a local instrument zone supersedes a
+     * global instrument zone generator.  Both cases supersede
+     * the default generator -> voice_gen_set */
 
-      /* run thru all the zones of this instrument */
-      inst_zone = fluid_inst_get_zone(inst);
-	  while (inst_zone != NULL) {
-	/* make sure this instrument zone has a valid sample */
-	sample = fluid_inst_zone_get_sample(inst_zone);
-	if ((sample == NULL) || fluid_sample_in_rom(sample)) {
-	  inst_zone = fluid_inst_zone_next(inst_zone);
-	  continue;
-	}
+    if (inst_zone->gen[i].flags){
+      gens[gen_count].num = i;
+      gens[gen_count++].val = inst_zone->gen[i].val;
 
-	/* check if the instrument zone is ignored and the note falls into
-	   the key and velocity range of this  instrument zone.
-	   An instrument zone must be ignored when its voice is already running
-	   played by a legato passage (see fluid_synth_noteon_monopoly_legato()) */
-	if (fluid_zone_inside_range(&inst_zone->range, key, vel)) {
+    } else if ((global_inst_zone != NULL) && (global_inst_zone->gen[i].flags)) {
+      gens[gen_count].num = i;
+      gens[gen_count++].val = global_inst_zone->gen[i].val;
 
-	  /* this is a good zone. allocate a new synthesis process and initialize it */
-	  voice = fluid_synth_alloc_voice_LOCAL(synth, sample, chan, key, vel, &inst_zone->range);
-	  if (voice == NULL) {
-	    return FLUID_FAILED;
-	  }
+    } else {
+      /* The generator has not been defined in this instrument.
+       * Do nothing, leave it at the default.
+       */
+    }
 
+  } /* for all generators */
 
-	  /* Instrument level, generators */
+  pair->inst_gen_count = gen_count;
 
-	  for (i = 0; i < GEN_LAST; i++) {
+  /* global instrument zone, modulators: Put them all into a
+   * list. */
 
-	    /* SF 2.01 section 9.4 'bullet' 4:
-	     *
-	     * A generator in a local instrument zone supersedes a
-	     * global instrument zone generator.  Both cases supersede
-	     * the default generator -> voice_gen_set */
+  mod_list_count = 0;
 
-	    if (inst_zone->gen[i].flags){
-	      fluid_voice_gen_set(voice, i, inst_zone->gen[i].val);
+  if (global_inst_zone){
+    mod = global_inst_zone->mod;
+    while (mod){
+      mod_list[mod_list_count++] = mod;
+      mod = mod->next;
+    }
+  }
+
+  /* local instrument zone, modulators.
+   * Replace modulators with the same definition in the list:
+   * SF 2.01 page 69, 'bullet' 8
+   */
+  mod = inst_zone->mod;
 
-	    } else if ((global_inst_zone != NULL) && (global_inst_zone->gen[i].flags)) {
-	      fluid_voice_gen_set(voice, i, global_inst_zone->gen[i].val);
+  while (mod){
 
-	    } else {
-	      /* The generator has not been defined in this instrument.
-	       * Do nothing, leave it at the default.
-	       */
-	    }
+    /* 'Identical' modulators will be deleted by setting their
+     *  list entry to NULL.  The list length is known, NULL
+     *  entries will be ignored later.  SF2.01 section 9.5.1
+     *  page 69, 'bullet' 3 defines 'identical'.  */
+
+    for (i = 0; i < mod_list_count; i++){
+      if (mod_list[i] && fluid_mod_test_identity(mod,mod_list[i])){
+        mod_list[i] = NULL;
+      }
+    }
+
+    /* Finally add the new modulator to to the list. */
+    mod_list[mod_list_count++] = mod;
+    mod = mod->next;
+  }
 
-	  } /* for all generators */
+  /* Keep the instrument modulators (global / local) of the voice. */
+  for (i = 0; i < mod_list_count; i++){
+    if (mod_list[i] != NULL){ /* disabled modulators CANNOT be skipped. */
+      mods[mod_count++] = mod_list[i];
+    }
+  }
 
-	  /* global instrument zone, modulators: Put them all into a
-	   * list. */
+  pair->inst_mod_count = mod_count;
+
+  /* Preset level, generators */
+
+  for (i = 0; i < GEN_LAST; i++) {
+
+    /* SF 2.01 section 8.5 page 58: If some generators are
+     * encountered at preset level, they should be ignored */
+    if ((i != GEN_STARTADDROFS)
+        && (i != GEN_ENDADDROFS)
+        && (i != GEN_STARTLOOPADDROFS)
+        && (i != GEN_ENDLOOPADDROFS)
+        && (i != GEN_STARTADDRCOARSEOFS)
+        && (i != GEN_ENDADDRCOARSEOFS)
+        && (i != GEN_STARTLOOPADDRCOARSEOFS)
+        && (i != GEN_KEYNUM)
+        && (i != GEN_VELOCITY)
+        && (i != GEN_ENDLOOPADDRCOARSEOFS)
+        && (i != GEN_SAMPLEMODE)
+        && (i != GEN_EXCLUSIVECLASS)
+        && (i != GEN_OVERRIDEROOTKEY)) {
+
+      /* SF 2.01 section 9.4 'bullet' 9: A generator in a
+       * local preset zone supersedes a global preset zone
+       * generator.  The effect is -added- to the destination
+       * summing node -> voice_gen_incr */
+
+      if (preset_zone->gen[i].flags) {
+        gens[gen_count].num = i;
+        gens[gen_count++].val = preset_zone->gen[i].val;
+      } else if ((global_preset_zone != NULL) && global_preset_zone->gen[i].flags) {
+        gens[gen_count].num = i;
+        gens[gen_count++].val = global_preset_zone->gen[i].val;
+      } else {
+        /* The generator has not been defined in this preset
+         * Do nothing, leave it unchanged.
+         */
+      }
+    } /* if available at preset level */
+  } /* for all generators */
 
-	  mod_list_count = 0;
 
-	  if (global_inst_zone){
-	    mod = global_inst_zone->mod;
-	    while (mod){
-	      mod_list[mod_list_count++] = mod;
-	      mod = mod->next;
-	    }
-	  }
+  /* Global preset zone, modulators: put them all into a
+   * list. */
+  mod_list_count = 0;
+  if (global_preset_zone){
+    mod = global_preset_zone->mod;
+    while (mod){
+      mod_list[mod_list_count++] = mod;
+      mod = mod->next;
+    }
+  }
 
-	  /* local instrument zone, modulators.
-	   * Replace modulators with the same definition in the list:
-	   * SF 2.01 page 69, 'bullet' 8
-	   */
-	  mod = inst_zone->mod;
+  /* Process the modulators of the local preset zone.  Kick
+   * out all identical modulators from the global preset zone
+   * (SF 2.01 page 69, second-last bullet) */
 
-	  while (mod){
+  mod = preset_zone->mod;
+  while (mod){
+    for (i = 0; i < mod_list_count; i++){
+      if (mod_list[i] && fluid_mod_test_identity(mod,mod_list[i])){
+        mod_list[i] = NULL;
+      }
+    }
 
-	    /* 'Identical' modulators will be deleted by setting their
-	     *  list entry to NULL.  The list length is known, NULL
-	     *  entries will be ignored later.  SF2.01 section 9.5.1
-	     *  page 69, 'bullet' 3 defines 'identical'.  */
+    /* Finally add the new modulator to the list. */
+    mod_list[mod_list_count++] = mod;
+    mod = mod->next;
+  }
 
-	    for (i = 0; i < mod_list_count; i++){
-	      if (mod_list[i] && fluid_mod_test_identity(mod,mod_list[i])){
-		mod_list[i] = NULL;
-	      }
-	    }
+  /* Keep the preset modulators (global / local) of the voice. */
+  for (i = 0; i < mod_list_count; i++){
+    mod = mod_list[i];
+    if ((mod != NULL) && (mod->amount != 0)) { /* disabled modulators can be skipped. */
+      mods[mod_count++] = mod;
+    }
+  }
 
-	    /* Finally add the new modulator to to the list. */
-	    mod_list[mod_list_count++] = mod;
-	    mod = mod->next;
-	  }
+  pair->gen_count = gen_count;
+  pair->mod_count = mod_count;
 
-	  /* Add instrument modulators (global / local) to the voice. */
-	  for (i = 0; i < mod_list_count; i++){
+  if (gen_count > 0) {
+    pair->gens = FLUID_ARRAY(fluid_zone_gen_t, gen_count);
+    if (pair->gens == NULL) {
+      return FLUID_FAILED;
+    }
+    FLUID_MEMCPY(pair->gens, gens, gen_count * sizeof(fluid_zone_gen_t));
+  }
+  if (mod_count > 0) {
+    pair->mods = FLUID_ARRAY(fluid_mod_t*, mod_count);
+    if (pair->mods == NULL) {
+      return FLUID_FAILED;
+    }
+    FLUID_MEMCPY(pair->mods, mods, mod_count * sizeof(fluid_mod_t*));
+  }
 
-	    mod = mod_list[i];
+  return FLUID_OK;
+}
 
-	    if (mod != NULL){ /* disabled modulators CANNOT be skipped. */
+/* Append the pair indexes of a map cell to the lists, unless an identical
+ * list exists in a neighbouring cell. Returns the list number or -1 if out
+ * of memory. */
+static int
+fluid_zone_map_add_list(fluid_zone_map_t* map, int* list_count, int* list_size,
+                        const int* pairs, int count, int neighbour1, int neighbour2)
+{
+  int* new_lists;
+  int* new_start;
+  int neighbour[2];
+  int i, n;
+
+  neighbour[0] = neighbour1;
+  neighbour[1] = neighbour2;
+  for (i = 0; i < 2; i++) {
+    n = neighbour[i];
+    if ((n >= 0) && (map->list_start[n + 1] - map->list_start[n] == count)
+        && ((count == 0)
+            || (FLUID_MEMCMP(&map->lists[map->list_start[n]], pairs, count * sizeof(int)) == 0))) {
+      return n;
+    }
+  }
 
-	      /* Instrument modulators -supersede- existing (default)
-	       * modulators.  SF 2.01 page 69, 'bullet' 6 */
-	      fluid_voice_add_mod(voice, mod, FLUID_VOICE_OVERWRITE);
-	    }
-	  }
+  n = map->list_start[*list_count];
+  if (n + count > *list_size) {
+    *list_size = 2 * (n + count);
+    new_lists = FLUID_REALLOC(map->lists, *list_size * sizeof(int));
+    if (new_lists == NULL) {
+      return -1;
+    }
+    map->lists = new_lists;
+  }
+  new_start = FLUID_REALLOC(map->list_start, (*list_count + 2) * sizeof(int));
+  if (new_start == NULL) {
+    return -1;
+  }
+  map->list_start = new_start;
 
-	  /* Preset level, generators */
-
-	  for (i = 0; i < GEN_LAST; i++) {
-
-	    /* SF 2.01 section 8.5 page 58: If some generators are
-	     * encountered at preset level, they should be ignored */
-	    if ((i != GEN_STARTADDROFS)
-		&& (i != GEN_ENDADDROFS)
-		&& (i != GEN_STARTLOOPADDROFS)
-		&& (i != GEN_ENDLOOPADDROFS)
-		&& (i != GEN_STARTADDRCOARSEOFS)
-		&& (i != GEN_ENDADDRCOARSEOFS)
-		&& (i != GEN_STARTLOOPADDRCOARSEOFS)
-		&& (i != GEN_KEYNUM)
-		&& (i != GEN_VELOCITY)
-		&& (i != GEN_ENDLOOPADDRCOARSEOFS)
-		&& (i != GEN_SAMPLEMODE)
-		&& (i != GEN_EXCLUSIVECLASS)
-		&& (i != GEN_OVERRIDEROOTKEY)) {
-
-	      /* SF 2.01 section 9.4 'bullet' 9: A generator in a
-	       * local preset zone supersedes a global preset zone
-	       * generator.  The effect is -added- to the destination
-	       * summing node -> voice_gen_incr */
-
-	      if (preset_zone->gen[i].flags) {
-		fluid_voice_gen_incr(voice, i, preset_zone->gen[i].val);
-	      } else if ((global_preset_zone != NULL) && global_preset_zone->gen[i].flags) {
-		fluid_voice_gen_incr(voice, i, global_preset_zone->gen[i].val);
-	      } else {
-		/* The generator has not been defined in this preset
-		 * Do nothing, leave it unchanged.
-		 */
-	      }
-	    } /* if available at preset level */
-	  } /* for all generators */
-
-
-	  /* Global preset zone, modulators: put them all into a
-	   * list. */
-	  mod_list_count = 0;
-	  if (global_preset_zone){
-	    mod = global_preset_zone->mod;
-	    while (mod){
-	      mod_list[mod_list_count++] = mod;
-	      mod = mod->next;
-	    }
-	  }
+  if (count > 0) {
+    FLUID_MEMCPY(&map->lists[n], pairs, count * sizeof(int));
+  }
+  map->list_start[*list_count + 1] = n + count;
+  return (*list_count)++;
+}
 
-	  /* Process the modulators of the local preset zone.  Kick
-	   * out all identical modulators from the global preset zone
-	   * (SF 2.01 page 69, second-last bullet) */
+/* Intersect the ranges of a preset zone and one of its instrument zones,
+ * limited to valid MIDI values. Returns TRUE if any note falls into both. */
+static int
+fluid_zone_pair_get_range(fluid_preset_zone_t* preset_zone,
+                          fluid_inst_zone_t* inst_zone, fluid_zone_range_t* range)
+{
+  fluid_zone_range_t* p = &preset_zone->range;
+  fluid_zone_range_t* i = &inst_zone->range;
 
-	  mod = preset_zone->mod;
-	  while (mod){
-	    for (i = 0; i < mod_list_count; i++){
-	      if (mod_list[i] && fluid_mod_test_identity(mod,mod_list[i])){
-		mod_list[i] = NULL;
-	      }
-	    }
+  range->keylo = (p->keylo > i->keylo) ? p->keylo : i->keylo;
+  range->keyhi = (p->keyhi < i->keyhi) ? p->keyhi : i->keyhi;
+  range->vello = (p->vello > i->vello) ? p->vello : i->vello;
+  range->velhi = (p->velhi < i->velhi) ? p->velhi : i->velhi;
+  range->ignore = FALSE;
 
-	    /* Finally add the new modulator to the list. */
-	    mod_list[mod_list_count++] = mod;
-	    mod = mod->next;
-	  }
+  if (range->keylo < 0) range->keylo = 0;
+  if (range->keyhi > 127) range->keyhi = 127;
+  if (range->vello < 0) range->vello = 0;
+  if (range->velhi > 127) range->velhi = 127;
 
-	  /* Add preset modulators (global / local) to the voice. */
-	  for (i = 0; i < mod_list_count; i++){
-	    mod = mod_list[i];
-	    if ((mod != NULL) && (mod->amount != 0)) { /* disabled modulators can be skipped. */
+  return (range->keylo <= range->keyhi) && (range->vello <= range->velhi);
+}
 
-	      /* Preset modulators -add- to existing instrument /
-	       * default modulators.  SF2.01 page 70 first bullet on
-	       * page */
-	      fluid_voice_add_mod(voice, mod, FLUID_VOICE_ADD);
-	    }
-	  }
+/*
+ * new_fluid_zone_map
+ *
+ * Precompute which zones of a preset play each key and velocity, so that a
+ * noteon doesn't need to check the range of every preset and instrument
+ * zone. Instrument zones without a usable sample are left out.
+ */
+fluid_zone_map_t*
+new_fluid_zone_map(fluid_defpreset_t* preset)
+{
+  fluid_zone_map_t* map;
+  fluid_preset_zone_t* preset_zone;
+  fluid_inst_zone_t* inst_zone;
+  fluid_zone_range_t range;
+  fluid_sample_t* sample;
+  int* cell_pairs = NULL;
+  char split[129];
+  int pair_count, list_count, list_size;
+  int i, key, bucket, vel, count, list, above, before;
+
+  map = FLUID_NEW(fluid_zone_map_t);
+  if (map == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(map, 0, sizeof(fluid_zone_map_t));
+  FLUID_MEMSET(split, 0, sizeof(split));
+
+  /* collect the playable zone pairs, in the order a noteon visits them */
+  pair_count = 0;
+  for (i = 0; i < 2; i++) {
+    pair_count = 0;
+    for (preset_zone = fluid_defpreset_get_zone(preset); preset_zone != NULL;
+         preset_zone = fluid_preset_zone_next(preset_zone)) {
+      if (fluid_preset_zone_get_inst(preset_zone) == NULL) {
+        continue;
+      }
+      for (inst_zone = fluid_inst_get_zone(fluid_preset_zone_get_inst(preset_zone));
+           inst_zone != NULL; inst_zone = fluid_inst_zone_next(inst_zone)) {
+        sample = fluid_inst_zone_get_sample(inst_zone);
+        if ((sample == NULL) || fluid_sample_in_rom(sample)) {
+          continue;
+        }
+        if (!fluid_zone_pair_get_range(preset_zone, inst_zone, &range)) {
+          continue;
+        }
+        if (i == 1) {
+          map->pairs[pair_count].preset_zone = preset_zone;
+          map->pairs[pair_count].inst_zone = inst_zone;
+          map->pairs[pair_count].range = range;
+          split[range.vello] = 1;
+          split[range.velhi + 1] = 1;
+        }
+        pair_count++;
+      }
+    }
+    if ((i == 0) && (pair_count > 0)) {
+      map->pairs = FLUID_ARRAY(fluid_zone_pair_t, pair_count);
+      cell_pairs = FLUID_ARRAY(int, pair_count);
+      if ((map->pairs == NULL) || (cell_pairs == NULL)) {
+        goto error_recovery;
+      }
+      FLUID_MEMSET(map->pairs, 0, pair_count * sizeof(fluid_zone_pair_t));
+    }
+  }
+  map->pair_count = pair_count;
 
-	  /* add the synthesis process to the synthesis loop. */
-	  fluid_synth_start_voice(synth, voice);
+  /* merge the generators and modulators each pair passes on to its voices */
+  for (i = 0; i < pair_count; i++) {
+    if (fluid_zone_pair_merge(&map->pairs[i], fluid_defpreset_get_global_zone(preset)) != FLUID_OK) {
+      goto error_recovery;
+    }
+  }
 
-	  /* Store the ID of the first voice that was created by this noteon event.
-	   * Exclusive class may only terminate older voices.
-	   * That avoids killing voices, which have just been created.
-	   * (a noteon event can create several voice processes with the same exclusive
-	   * class - for example when using stereo samples)
-	   */
-	}
+  /* velocities between two range boundaries play the same zones */
+  map->vel_buckets = 0;
+  for (vel = 0; vel < 128; vel++) {
+    if (split[vel] && (vel > 0)) {
+      map->vel_buckets++;
+    }
+    map->vel_bucket[vel] = (unsigned char) map->vel_buckets;
+  }
+  map->vel_buckets++;
 
-	inst_zone = fluid_inst_zone_next(inst_zone);
+  map->cell = FLUID_ARRAY(unsigned short, 128 * map->vel_buckets);
+  map->list_start = FLUID_ARRAY(int, 1);
+  if ((map->cell == NULL) || (map->list_start == NULL)) {
+    goto error_recovery;
+  }
+  map->list_start[0] = 0;
+  list_count = 0;
+  list_size = 0;
+
+  vel = 0;
+  for (bucket = 0; bucket < map->vel_buckets; bucket++) {
+    /* first velocity of this bucket */
+    while (map->vel_bucket[vel] != bucket) {
+      vel++;
+    }
+    for (key = 0; key < 128; key++) {
+      count = 0;
+      for (i = 0; i < pair_count; i++) {
+        if ((map->pairs[i].range.keylo <= key) && (key <= map->pairs[i].range.keyhi)
+            && (map->pairs[i].range.vello <= vel) && (vel <= map->pairs[i].range.velhi)) {
+          cell_pairs[count++] = i;
+        }
       }
-	}
-    preset_zone = fluid_preset_zone_next(preset_zone);
+      before = (key > 0) ? map->cell[(key - 1) * map->vel_buckets + bucket] : -1;
+      above = (bucket > 0) ? map->cell[key * map->vel_buckets + bucket - 1] : -1;
+      list = fluid_zone_map_add_list(map, &list_count, &list_size, cell_pairs,
+                                     count, before, above);
+      if (list < 0) {
+        goto error_recovery;
+      }
+      map->cell[key * map->vel_buckets + bucket] = (unsigned short) list;
+    }
   }
 
-  return FLUID_OK;
+  FLUID_FREE(cell_pairs);
+  return map;
+
+error_recovery:
+  FLUID_LOG(FLUID_ERR, "Out of memory");
+  FLUID_FREE(cell_pairs);
+  delete_fluid_zone_map(map);
+  return NULL;
+}
+
+/*
+ * delete_fluid_zone_map
+ */
+void
+delete_fluid_zone_map(fluid_zone_map_t* map)
+{
+  int i;
+
+  fluid_return_if_fail(map != NULL);
+
+  for (i = 0; i < map->pair_count; i++) {
+    FLUID_FREE(map->pairs[i].gens);
+    FLUID_FREE(map->pairs[i].mods);
+  }
+  FLUID_FREE(map->pairs);
+  FLUID_FREE(map->lists);
+  FLUID_FREE(map->list_start);
+  FLUID_FREE(map->cell);
+  FLUID_FREE(map);
 }
 
 /*
@@ -1373,6 +3376,9 @@ fluid_preset_zone_import_sfont(fluid_preset_zone_t* zone, SFZone *sfzone, fluid_
       mod_dest->amount = 0;
     }
 
+    /* Flag the default vel-to-filter modulator, voices leave it out */
+    fluid_mod_check_vel2filter(mod_dest);
+
     /* Store the new modulator in the zone The order of modulators
      * will make a difference, at least in an instrument context: The
      * second modulator overwrites the first one, if they only differ
@@ -1779,6 +3785,9 @@ fluid_inst_zone_import_sfont(fluid_preset_zone_t* preset_zone, fluid_inst_zone_t
       mod_dest->amount = 0;
     }
 
+    /* Flag the default vel-to-filter modulator, voices leave it out */
+    fluid_mod_check_vel2filter(mod_dest);
+
     /* Store the new modulator in the zone
      * The order of modulators will make a difference, at least in an instrument context:
      * The second modulator overwrites the first one, if they only differ in amount. */
@@ -1838,8 +3847,30 @@ fluid_sample_in_rom(fluid_sample_t* sample)
   return (sample->sampletype & FLUID_SAMPLETYPE_ROM);
 }
 
+/*
+ * Check whether an imported sample can be played.
+ */
+static void
+fluid_sample_check_sfont(fluid_sample_t* sample)
+{
+  if (sample->sampletype & FLUID_SAMPLETYPE_ROM) {
+    sample->valid = 0;
+    FLUID_LOG(FLUID_WARN, "Ignoring sample '%s': can't use ROM samples", sample->name);
+  }
+  else if (sample->end - sample->start < 8) {
+    sample->valid = 0;
+    FLUID_LOG(FLUID_WARN, "Ignoring sample '%s': too few sample data points", sample->name);
+  }
+  else {
+    sample->valid = TRUE;
+  }
+}
+
 /*
  * fluid_sample_import_sfont
+ *
+ * Imports the header of a sample. Compressed samples stay invalid until
+ * fluid_sample_import_sfont_data() has decoded them.
  */
 int
 fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defsfont_t* sfont)
@@ -1856,28 +3887,45 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
   sample->pitchadj = sfsample->pitchadj;
   sample->sampletype = sfsample->sampletype;
 
+  if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) {
+    sample->valid = 0;
+  }
+  else {
+    fluid_sample_check_sfont(sample);
+  }
+
+  return FLUID_OK;
+}
+
+/*
+ * fluid_sample_import_sfont_data
+ *
+ * Imports the data of a sample once the sample data of the SoundFont is
+ * loaded, decoding it if it's compressed, and scans its loop. The samples
+ * of a SoundFont don't share any state here, so they can be imported by
+ * several threads at once.
+ */
+int
+fluid_sample_import_sfont_data(fluid_sample_t* sample, fluid_defsfont_t* sfont)
+{
+  int ret;
+
+  sample->data = sfont->sampledata;
+  sample->data24 = sfont->sample24data;
+
   if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
   {
-    int ret = uncompress_vorbis_sample(sample);
+    ret = uncompress_vorbis_sample(sample);
     if (sample->data == NULL || ret == FLUID_FAILED)
     {
       sample->valid = 0;
       return ret;
     }
-  }
 
-  if (sample->sampletype & FLUID_SAMPLETYPE_ROM) {
-    sample->valid = 0;
-    FLUID_LOG(FLUID_WARN, "Ignoring sample '%s': can't use ROM samples", sample->name);
-  }
-  else if (sample->end - sample->start < 8) {
-    sample->valid = 0;
-    FLUID_LOG(FLUID_WARN, "Ignoring sample '%s': too few sample data points", sample->name);
-  }
-  else {
-    sample->valid = TRUE;
+    fluid_sample_check_sfont(sample);
   }
 
+  fluid_voice_optimize_sample(sample);
   return FLUID_OK;
 }
 
@@ -3284,6 +5332,8 @@ load_shdr (unsigned int size, SFData * sf, void * fd, const fluid_file_callbacks
       FSKIPW (fd, fcbs);		/* skip sample link */
       READW (p->sampletype, fd, fcbs);
       p->samfile = 0;
+      p->amplitude_that_reaches_noise_floor = 0;
+      p->fluid_sample = NULL;
     }
 
   FSKIP (SFSHDRSIZE, fd, fcbs);	/* skip terminal shdr */
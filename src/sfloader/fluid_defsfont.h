@@ -116,6 +116,7 @@ typedef struct _SFSample
   signed char pitchadj;		/* pitch correction in cents */
   unsigned short sampletype;		/* 1 mono,2 right,4 left,linked 8,0x8000=ROM */
   fluid_sample_t *fluid_sample;	/* Imported sample (fixed up in fluid_defsfont_load) */
+  double amplitude_that_reaches_noise_floor; /* From the index cache, 0 if unknown */
 }
 SFSample;
 
@@ -344,6 +345,10 @@ typedef struct _fluid_defpreset_t fluid_defpreset_t;
 typedef struct _fluid_preset_zone_t fluid_preset_zone_t;
 typedef struct _fluid_inst_t fluid_inst_t;
 typedef struct _fluid_inst_zone_t fluid_inst_zone_t;            /**< Soundfont Instrument Zone */
+typedef struct _fluid_zone_gen_t fluid_zone_gen_t;
+typedef struct _fluid_zone_pair_t fluid_zone_pair_t;
+typedef struct _fluid_zone_map_t fluid_zone_map_t;
+typedef struct _fluid_sample_streamer_t fluid_sample_streamer_t;
 
 /* defines the velocity and key range for a zone */
 struct _fluid_zone_range_t
@@ -377,6 +382,7 @@ const char* fluid_defpreset_preset_get_name(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_banknum(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_num(fluid_preset_t* preset);
 int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth, int chan, int key, int vel);
+int fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan);
 
 int fluid_zone_inside_range(fluid_zone_range_t* zone_range, int key, int vel);
 
@@ -396,7 +402,15 @@ struct _fluid_defsfont_t
   
   fluid_list_t* sample;      /* the samples in this soundfont */
   fluid_defpreset_t* preset; /* the presets of this soundfont */
+  fluid_hashtable_t* preset_index; /* the presets by bank and program number */
   int mlock;                 /* Should we try memlock (avoid swapping)? */
+  int mmap;                  /* Should we try to map the sample data from the file? */
+  int stream_head;           /* msec of each sample kept in ram when streaming, 0 if not streaming */
+  int dynamic_loading;       /* Should the sample data of a preset be loaded when it's used? */
+  int unload_delay;          /* msec after which unused streamed or dynamically loaded data is released */
+  char* cache_dir;           /* the directory of the index cache, NULL if not caching */
+  int load_threads;          /* the number of threads importing the samples */
+  fluid_sample_streamer_t* streamer; /* reads the sample data while it's played, NULL if loaded in ram */
 
   fluid_defpreset_t* iter_cur;       /* the current preset in the iteration */
 
@@ -430,6 +444,7 @@ struct _fluid_defpreset_t
   unsigned int num;                     /* the preset number */
   fluid_preset_zone_t* global_zone;        /* the global zone of the preset */
   fluid_preset_zone_t* zone;               /* the chained list of preset zones */
+  fluid_zone_map_t* zone_map;              /* the zones to play by key and velocity, built on first use */
 };
 
 fluid_defpreset_t* new_fluid_defpreset(fluid_defsfont_t* sfont);
@@ -458,6 +473,56 @@ struct _fluid_preset_zone_t
   fluid_mod_t * mod; /* List of modulators */
 };
 
+/* a generator a zone pair sets (instrument level) or adds (preset level) */
+struct _fluid_zone_gen_t
+{
+  int num;
+  double val;
+};
+
+/*
+ * fluid_zone_pair_t
+ *
+ * A preset zone together with one zone of its instrument, that is the
+ * SoundFont data one voice of a noteon is made of. The generators and
+ * modulators of the local and global zones are merged once, so that a
+ * noteon only has to pass them on to the voice.
+ */
+struct _fluid_zone_pair_t
+{
+  fluid_preset_zone_t* preset_zone;
+  fluid_inst_zone_t* inst_zone;
+  fluid_zone_range_t range;        /* the keys and velocities both zones play */
+  fluid_zone_gen_t* gens;          /* instrument generators, then preset generators */
+  int inst_gen_count;              /* number of instrument generators in gens */
+  int gen_count;                   /* number of all generators in gens */
+  fluid_mod_t** mods;              /* instrument modulators, then preset modulators */
+  int inst_mod_count;              /* number of instrument modulators in mods */
+  int mod_count;                   /* number of all modulators in mods */
+};
+
+/*
+ * fluid_zone_map_t
+ *
+ * Lookup of the zone pairs that play a key and velocity. Velocities are
+ * grouped into buckets in which all velocities play the same zones. Each
+ * cell (key * vel_buckets + bucket) refers to a list of pair indexes,
+ * list n being lists[list_start[n]] to lists[list_start[n + 1] - 1].
+ */
+struct _fluid_zone_map_t
+{
+  fluid_zone_pair_t* pairs;        /* the playable zone pairs, in SoundFont order */
+  int pair_count;                  /* number of pairs */
+  int* lists;                      /* the lists of pair indexes, one after the other */
+  int* list_start;                 /* index of the first entry of each list in lists */
+  unsigned short* cell;            /* list of each key and velocity bucket */
+  int vel_buckets;                 /* number of velocity buckets */
+  unsigned char vel_bucket[128];   /* velocity bucket of each velocity */
+};
+
+fluid_zone_map_t* new_fluid_zone_map(fluid_defpreset_t* preset);
+void delete_fluid_zone_map(fluid_zone_map_t* map);
+
 fluid_preset_zone_t* new_fluid_preset_zone(char* name);
 void delete_fluid_preset_zone(fluid_preset_zone_t* zone);
 fluid_preset_zone_t* fluid_preset_zone_next(fluid_preset_zone_t* preset);
@@ -507,6 +572,7 @@ fluid_sample_t* fluid_inst_zone_get_sample(fluid_inst_zone_t* zone);
 
 
 int fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defsfont_t* sfont);
+int fluid_sample_import_sfont_data(fluid_sample_t* sample, fluid_defsfont_t* sfont);
 int fluid_sample_in_rom(fluid_sample_t* sample);
 
 
@@ -110,6 +110,9 @@ typedef void (*fluid_sfont_iteration_start_t)(fluid_sfont_t* sfont);
  */
 typedef int (*fluid_sfont_iteration_next_t)(fluid_sfont_t* sfont, fluid_preset_t* preset);
 
+/* default file callbacks of a SoundFont loader, reading from the file system */
+void * default_fopen(const char * path);
+
 void fluid_sfont_set_iteration_start(fluid_sfont_t* sfont, fluid_sfont_iteration_start_t iter_start);
 void fluid_sfont_set_iteration_next(fluid_sfont_t* sfont, fluid_sfont_iteration_next_t iter_next);
 
@@ -54,6 +54,12 @@ new_fluid_channel(fluid_synth_t* synth, int num)
   chan->channum = num;
   chan->preset = NULL;
   chan->tuning = NULL;
+  chan->voices = NULL;
+  FLUID_MEMSET(chan->key_voices, 0, sizeof(chan->key_voices));
+  FLUID_MEMSET(chan->excl_voices, 0, sizeof(chan->excl_voices));
+  FLUID_MEMSET(chan->pending_mod, 0, sizeof(chan->pending_mod));
+  FLUID_MEMSET(chan->pending_key_pressure, 0, sizeof(chan->pending_key_pressure));
+  chan->has_pending = FALSE;
 
   fluid_channel_init(chan);
   fluid_channel_init_ctrl(chan, 0);
@@ -141,6 +141,18 @@ struct _fluid_channel_t
   /* Drum channel flag, CHANNEL_TYPE_MELODIC, or CHANNEL_TYPE_DRUM. */
   int channel_type;
 
+  /* Index of the voices assigned to this channel, i.e. the voices initialized
+   * on this channel and not yet stopped. See fluid_voice_init(). */
+  fluid_voice_t* voices;                /**< all voices of this channel */
+  fluid_voice_t* key_voices[128];       /**< voices of this channel by MIDI key */
+  fluid_voice_t* excl_voices[128];      /**< playing voices by exclusive class (modulo 128) */
+
+  /* Controller updates of the voices deferred to the next block, see
+   * synth.coalesce-controllers. Bit n of pending_mod is set for the
+   * modulator source n: MIDI CCs 0-127, general controllers 128-255. */
+  unsigned int pending_mod[8];
+  unsigned int pending_key_pressure[4]; /**< by MIDI key */
+  int has_pending;                      /**< TRUE if any bit is set */
 };
 
 fluid_channel_t* new_fluid_channel(fluid_synth_t* synth, int num);
@@ -36,6 +36,7 @@ fluid_mod_clone(fluid_mod_t* mod, const fluid_mod_t* src)
   mod->flags1 = src->flags1;
   mod->src2 = src->src2;
   mod->flags2 = src->flags2;
+  mod->vel2filter = src->vel2filter;
   mod->amount = src->amount;
 }
 
@@ -52,6 +53,7 @@ fluid_mod_set_source1(fluid_mod_t* mod, int src, int flags)
 {
   mod->src1 = src;
   mod->flags1 = flags;
+  fluid_mod_check_vel2filter(mod);
 }
 
 /**
@@ -67,6 +69,7 @@ fluid_mod_set_source2(fluid_mod_t* mod, int src, int flags)
 {
   mod->src2 = src;
   mod->flags2 = flags;
+  fluid_mod_check_vel2filter(mod);
 }
 
 /**
@@ -78,6 +81,7 @@ void
 fluid_mod_set_dest(fluid_mod_t* mod, int dest)
 {
   mod->dest = dest;
+  fluid_mod_check_vel2filter(mod);
 }
 
 /**
@@ -333,62 +337,108 @@ fluid_mod_transform_source_value(fluid_real_t val, unsigned char mod_flags, cons
     return val;
 }
 
+/* Number of mapping functions: 16 standard ones and 4 sinus ones */
+#define FLUID_MOD_TRANSFORMS 20
+
+/* Transformed values of the 7-bit sources by mapping function, for the
+ * ranges 127 and 126 (pan and balance, see fluid_mod_get_source_value()) */
+static fluid_real_t fluid_mod_transform_table[2][FLUID_MOD_TRANSFORMS][128];
+
+/* Index of the mapping function of the source flags in
+ * fluid_mod_transform_table, or -1 if unknown */
+static FLUID_INLINE int
+fluid_mod_get_transform_index(unsigned char mod_flags)
+{
+    mod_flags &= ~FLUID_MOD_CC;
+
+    if (mod_flags < 16) {
+        return mod_flags;
+    }
+    if ((mod_flags & ~(FLUID_MOD_BIPOLAR | FLUID_MOD_NEGATIVE)) == FLUID_MOD_SIN) {
+        return 16 + (mod_flags & (FLUID_MOD_BIPOLAR | FLUID_MOD_NEGATIVE));
+    }
+    return -1;
+}
+
+/*
+ * fluid_mod_config
+ *
+ * Precompute the mapping functions of all 7-bit source values. Requires
+ * fluid_conversion_config() to be called first.
+ */
+void
+fluid_mod_config(void)
+{
+    static const unsigned char sin_flags[4] = {
+        FLUID_MOD_SIN | FLUID_MOD_UNIPOLAR | FLUID_MOD_POSITIVE,
+        FLUID_MOD_SIN | FLUID_MOD_UNIPOLAR | FLUID_MOD_NEGATIVE,
+        FLUID_MOD_SIN | FLUID_MOD_BIPOLAR | FLUID_MOD_POSITIVE,
+        FLUID_MOD_SIN | FLUID_MOD_BIPOLAR | FLUID_MOD_NEGATIVE
+    };
+    unsigned char mod_flags;
+    int i, k, val;
+
+    for (i = 0; i < FLUID_MOD_TRANSFORMS; i++) {
+        mod_flags = (i < 16) ? (unsigned char) i : sin_flags[i - 16];
+
+        for (val = 0; val < 128; val++) {
+            for (k = 0; k < 2; k++) {
+                fluid_mod_transform_table[k][i][val] =
+                    fluid_mod_transform_source_value((fluid_real_t) val, mod_flags, (k == 0) ? 127 : 126);
+            }
+        }
+    }
+}
+
+/*
+ * fluid_mod_get_transformed_value
+ *
+ * Retrieve the value of a source and transform it into [0.0;1.0], from the
+ * precomputed table for 7-bit values.
+ */
+static FLUID_INLINE fluid_real_t
+fluid_mod_get_transformed_value(const unsigned char mod_src,
+                                const unsigned char mod_flags,
+                                const fluid_channel_t* chan,
+                                const fluid_voice_t* voice)
+{
+    fluid_real_t range = 127.0;
+    fluid_real_t val = fluid_mod_get_source_value(mod_src, mod_flags, &range, chan, voice);
+    int index = fluid_mod_get_transform_index(mod_flags);
+    int i = (int) val;
+
+    if ((index >= 0) && (i == val) && (i >= 0) && (i < 128)) {
+        if (range == 127.0) {
+            return fluid_mod_transform_table[0][index][i];
+        }
+        if (range == 126.0) {
+            return fluid_mod_transform_table[1][index][i];
+        }
+    }
+
+    /* 14-bit pitch wheel values and unknown mapping functions */
+    return fluid_mod_transform_source_value(val, mod_flags, range);
+}
+
 /*
  * fluid_mod_get_value
  */
 fluid_real_t
 fluid_mod_get_value(fluid_mod_t* mod, fluid_channel_t* chan, fluid_voice_t* voice)
 {
-  extern fluid_mod_t default_vel2filter_mod;
-  
   fluid_real_t v1 = 0.0, v2 = 1.0;
-  fluid_real_t range1 = 127.0, range2 = 127.0;
 
   if (chan == NULL) {
     return 0.0f;
   }
 
-  /* 'special treatment' for default controller
-   *
-   *  Reference: SF2.01 section 8.4.2
-   *
-   * The GM default controller 'vel-to-filter cut off' is not clearly
-   * defined: If implemented according to the specs, the filter
-   * frequency jumps between vel=63 and vel=64.  To maintain
-   * compatibility with existing sound fonts, the implementation is
-   * 'hardcoded', it is impossible to implement using only one
-   * modulator otherwise.
-   *
-   * I assume here, that the 'intention' of the paragraph is one
-   * octave (1200 cents) filter frequency shift between vel=127 and
-   * vel=64.  'amount' is (-2400), at least as long as the controller
-   * is set to default.
-   *
-   * Further, the 'appearance' of the modulator (source enumerator,
-   * destination enumerator, flags etc) is different from that
-   * described in section 8.4.2, but it matches the definition used in
-   * several SF2.1 sound fonts (where it is used only to turn it off).
-   * */
-  if (fluid_mod_test_identity(mod, &default_vel2filter_mod)) {
-// S. Christian Collins' mod, to stop forcing velocity based filtering
-/*
-    if (voice->vel < 64){
-      return (fluid_real_t) mod->amount / 2.0;
-    } else {
-      return (fluid_real_t) mod->amount * (127 - voice->vel) / 127;
-    }
-*/
-     return 0; // (fluid_real_t) mod->amount / 2.0;
-  }
-// end S. Christian Collins' mod
+  /* The default 'vel-to-filter cut off' modulator is never evaluated, the
+   * voice leaves it out when it starts (see fluid_mod_check_vel2filter()) */
 
-  /* get the initial value of the first source */
+  /* get the initial value of the first source and transform it */
   if (mod->src1 > 0)
   {
-    v1 = fluid_mod_get_source_value(mod->src1, mod->flags1, &range1, chan, voice);
-
-    /* transform the input value */
-    v1 = fluid_mod_transform_source_value(v1, mod->flags1, range1);
+    v1 = fluid_mod_get_transformed_value(mod->src1, mod->flags1, chan, voice);
   }
   else
   {
@@ -400,13 +450,10 @@ fluid_mod_get_value(fluid_mod_t* mod, fluid_channel_t* chan, fluid_voice_t* voic
     return 0.0f;
   }
 
-  /* get the second input source */
+  /* get the second input source and transform it */
   if (mod->src2 > 0)
   {
-    v2 = fluid_mod_get_source_value(mod->src2, mod->flags2, &range2, chan, voice);
-
-    /* transform the second input value */
-    v2 = fluid_mod_transform_source_value(v2, mod->flags2, range2);
+    v2 = fluid_mod_get_transformed_value(mod->src2, mod->flags2, chan, voice);
   }
   else
   {
@@ -417,6 +464,47 @@ fluid_mod_get_value(fluid_mod_t* mod, fluid_channel_t* chan, fluid_voice_t* voic
   return (fluid_real_t) mod->amount * v1 * v2;
 }
 
+/*
+ * fluid_mod_check_vel2filter
+ *
+ * 'special treatment' for default controller
+ *
+ *  Reference: SF2.01 section 8.4.2
+ *
+ * The GM default controller 'vel-to-filter cut off' is not clearly
+ * defined: If implemented according to the specs, the filter
+ * frequency jumps between vel=63 and vel=64.  To maintain
+ * compatibility with existing sound fonts, the implementation is
+ * 'hardcoded', it is impossible to implement using only one
+ * modulator otherwise.
+ *
+ * I assume here, that the 'intention' of the paragraph is one
+ * octave (1200 cents) filter frequency shift between vel=127 and
+ * vel=64.  'amount' is (-2400), at least as long as the controller
+ * is set to default.
+ *
+ * Further, the 'appearance' of the modulator (source enumerator,
+ * destination enumerator, flags etc) is different from that
+ * described in section 8.4.2, but it matches the definition used in
+ * several SF2.1 sound fonts (where it is used only to turn it off).
+ *
+ * S. Christian Collins' mod, to stop forcing velocity based filtering:
+ * the modulator doesn't contribute at all (it used to be amount / 2 below
+ * vel=64 and amount * (127 - vel) / 127 above). This flags the modulator
+ * once, when its sources or destination are set or it is loaded, and
+ * voices don't evaluate flagged modulators.
+ */
+void
+fluid_mod_check_vel2filter(fluid_mod_t* mod)
+{
+  /* same as default_vel2filter_mod, set up in fluid_synth_init() */
+  mod->vel2filter = (mod->dest == GEN_FILTERFC)
+    && (mod->src1 == FLUID_MOD_VELOCITY)
+    && (mod->flags1 == (FLUID_MOD_GC | FLUID_MOD_LINEAR | FLUID_MOD_UNIPOLAR | FLUID_MOD_NEGATIVE))
+    && (mod->src2 == FLUID_MOD_VELOCITY)
+    && (mod->flags2 == (FLUID_MOD_GC | FLUID_MOD_SWITCH | FLUID_MOD_UNIPOLAR | FLUID_MOD_POSITIVE));
+}
+
 /**
  * Create a new uninitialized modulator structure.
  * @return New allocated modulator or NULL if out of memory
@@ -429,6 +517,7 @@ new_fluid_mod()
     FLUID_LOG(FLUID_ERR, "Out of memory");
     return NULL;
   }
+  mod->vel2filter = FALSE;
   return mod;
 }
 
@@ -34,6 +34,7 @@ struct _fluid_mod_t
   unsigned char flags1;         /**< Source controller 1 flags */
   unsigned char src2;           /**< Source controller 2 */
   unsigned char flags2;         /**< Source controller 2 flags */
+  unsigned char vel2filter;     /**< Is it the default vel-to-filter modulator? (see fluid_mod_check_vel2filter()) */
   double amount;                /**< Multiplier amount */
   /* The 'next' field allows to link modulators into a list.  It is
    * not used in fluid_voice.c, there each voice allocates memory for a
@@ -43,7 +44,9 @@ struct _fluid_mod_t
   fluid_mod_t * next;
 };
 
+void fluid_mod_config(void);
 fluid_real_t fluid_mod_get_value(fluid_mod_t* mod, fluid_channel_t* chan, fluid_voice_t* voice);
+void fluid_mod_check_vel2filter(fluid_mod_t* mod);
 
 #ifdef DEBUG
 void fluid_dump_modulator(fluid_mod_t * mod);
@@ -35,6 +35,17 @@
 extern int feenableexcept (int excepts);
 #endif
 
+/* Synthesis processes are allocated on demand, this many at a time */
+#define FLUID_VOICE_CHUNK_SIZE 16
+
+/* A synthesis process together with the rvoices it renders with */
+typedef struct _fluid_voice_storage_t
+{
+  fluid_voice_t voice;
+  fluid_rvoice_t rvoice;
+  fluid_rvoice_t overflow_rvoice;
+} fluid_voice_storage_t;
+
 #define FLUID_API_RETURN(return_value) \
   do { fluid_synth_api_exit(synth); \
   return return_value; } while (0)
@@ -56,6 +67,7 @@ extern int feenableexcept (int excepts);
 
 static void fluid_synth_init(void);
 static void fluid_synth_api_enter(fluid_synth_t* synth);
+static int fluid_synth_api_try_enter(fluid_synth_t* synth);
 static void fluid_synth_api_exit(fluid_synth_t* synth);
 
 static int fluid_synth_noteon_LOCAL(fluid_synth_t* synth, int chan, int key,
@@ -72,6 +84,9 @@ static int fluid_synth_system_reset_LOCAL(fluid_synth_t* synth);
 static int fluid_synth_modulate_voices_LOCAL(fluid_synth_t* synth, int chan,
                                              int is_cc, int ctrl);
 static int fluid_synth_modulate_voices_all_LOCAL(fluid_synth_t* synth, int chan);
+static void fluid_synth_defer_modulation_LOCAL(fluid_synth_t* synth, int chan,
+                                              unsigned int* pending, int bit);
+static void fluid_synth_apply_pending_modulations(fluid_synth_t* synth);
 static int fluid_synth_update_channel_pressure_LOCAL(fluid_synth_t* synth, int channum);
 static int fluid_synth_update_key_pressure_LOCAL(fluid_synth_t* synth, int chan, int key);
 static int fluid_synth_update_pitch_bend_LOCAL(fluid_synth_t* synth, int chan);
@@ -88,16 +103,25 @@ fluid_synth_get_preset_by_sfont_name(fluid_synth_t* synth, const char *sfontname
 static void fluid_synth_update_presets(fluid_synth_t* synth);
 static void fluid_synth_update_gain_LOCAL(fluid_synth_t* synth);
 static int fluid_synth_update_polyphony_LOCAL(fluid_synth_t* synth, int new_polyphony);
+static void fluid_synth_init_free_voices_LOCAL(fluid_synth_t* synth);
+static void fluid_synth_update_steal_buckets_LOCAL(fluid_synth_t* synth);
 static void init_dither(void);
 static FLUID_INLINE int roundi (float x);
 static int fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount);
 
 static fluid_voice_t* fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t* synth);
+static int fluid_synth_add_voice_chunk_LOCAL(fluid_synth_t* synth);
+static void fluid_synth_enforce_cpu_voice_limit_LOCAL(fluid_synth_t* synth, int limit);
+static void fluid_synth_update_cpu_voice_limit(fluid_synth_t* synth, double time,
+                                               int blockcount);
 static void fluid_synth_kill_by_exclusive_class_LOCAL(fluid_synth_t* synth,
                                                       fluid_voice_t* new_voice);
 static fluid_sfont_info_t *new_fluid_sfont_info (fluid_synth_t *synth,
                                                  fluid_sfont_t *sfont);
 static int fluid_synth_sfunload_callback(void* data, unsigned int msec);
+static fluid_sfont_t* fluid_synth_load_sfont(fluid_synth_t* synth, const char* filename);
+static void fluid_synth_cleanup_sfload_requests(fluid_synth_t* synth, int wait);
+static void fluid_synth_invalidate_preset_cache(fluid_synth_t* synth);
 void fluid_synth_release_voice_on_same_note_LOCAL(fluid_synth_t* synth,
                                                             int chan, int key);
 static fluid_tuning_t* fluid_synth_get_tuning(fluid_synth_t* synth,
@@ -126,6 +150,11 @@ static void fluid_synth_handle_sample_rate(void *data, const char *name, double
 static void fluid_synth_handle_gain(void *data, const char *name, double value);
 static void fluid_synth_handle_polyphony(void *data, const char *name, int value);
 static void fluid_synth_handle_device_id(void *data, const char *name, int value);
+static void fluid_synth_handle_cpu_budget(void *data, const char *name, int value);
+static void fluid_synth_handle_coalesce_controllers(void *data, const char *name, int value);
+static void fluid_synth_handle_dynamic_quality(void *data, const char *name, int value);
+static void fluid_synth_handle_quality_level(void *data, const char *name, double value);
+static void fluid_synth_update_dynamic_quality_LOCAL(fluid_synth_t* synth);
 static void fluid_synth_handle_overflow(void *data, const char *name, double value);
 static void fluid_synth_handle_important_channels(void *data, const char *name,
         const char *value);
@@ -194,7 +223,15 @@ void fluid_synth_settings(fluid_settings_t* settings)
   fluid_settings_register_int(settings, "synth.reverb.active", 1, 0, 1, FLUID_HINT_TOGGLED);
   fluid_settings_register_int(settings, "synth.chorus.active", 1, 0, 1, FLUID_HINT_TOGGLED);
   fluid_settings_register_int(settings, "synth.ladspa.active", 0, 0, 1, FLUID_HINT_TOGGLED);
+  fluid_settings_register_int(settings, "synth.dynamic-quality.active", 0, 0, 1, FLUID_HINT_TOGGLED);
+  fluid_settings_register_num(settings, "synth.dynamic-quality.linear", -60.0, -144.0, 0.0, 0);
+  fluid_settings_register_num(settings, "synth.dynamic-quality.none", -80.0, -144.0, 0.0, 0);
   fluid_settings_register_int(settings, "synth.lock-memory", 1, 0, 1, FLUID_HINT_TOGGLED);
+  fluid_settings_register_int(settings, "synth.sample-mmap", 0, 0, 1, FLUID_HINT_TOGGLED);
+  fluid_settings_register_int(settings, "synth.sample-streaming", 0, 0, 10000, 0);
+  fluid_settings_register_int(settings, "synth.sample-unload-delay", 2000, 0, 3600000, 0);
+  fluid_settings_register_int(settings, "synth.dynamic-sample-loading", 0, 0, 1, FLUID_HINT_TOGGLED);
+  fluid_settings_register_str(settings, "synth.soundfont-cache-dir", "", 0);
   fluid_settings_register_str(settings, "midi.portname", "", 0);
 
 #ifdef DEFAULT_SOUNDFONT
@@ -210,8 +247,11 @@ void fluid_synth_settings(fluid_settings_t* settings)
   fluid_settings_register_num(settings, "synth.sample-rate", 44100.0f, 8000.0f, 96000.0f, 0);
   fluid_settings_register_int(settings, "synth.device-id", 0, 0, 126, 0);
   fluid_settings_register_int(settings, "synth.cpu-cores", 1, 1, 256, 0);
+  fluid_settings_register_int(settings, "synth.block-size", FLUID_BUFSIZE, 16, 2048, 0);
 
   fluid_settings_register_int(settings, "synth.min-note-length", 10, 0, 65535, 0);
+  fluid_settings_register_int(settings, "synth.cpu-budget", 0, 0, 100, 0);
+  fluid_settings_register_int(settings, "synth.coalesce-controllers", 0, 0, 1, FLUID_HINT_TOGGLED);
   
   fluid_settings_register_int(settings, "synth.threadsafe-api", 1, 0, 1, FLUID_HINT_TOGGLED);
   fluid_settings_register_int(settings, "synth.parallel-render", 1, 0, 1, FLUID_HINT_TOGGLED);
@@ -270,6 +310,8 @@ fluid_synth_init(void)
 
   fluid_conversion_config();
 
+  fluid_mod_config();
+
   fluid_rvoice_dsp_config();
 
   fluid_sys_config();
@@ -590,6 +632,10 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getint(settings, "synth.reverb.active", &synth->with_reverb);
   fluid_settings_getint(settings, "synth.chorus.active", &synth->with_chorus);
   fluid_settings_getint(settings, "synth.verbose", &synth->verbose);
+  fluid_settings_getint(settings, "synth.dynamic-quality.active", &synth->with_dynamic_quality);
+  fluid_settings_getnum(settings, "synth.dynamic-quality.linear", &synth->quality_linear);
+  fluid_settings_getnum(settings, "synth.dynamic-quality.none", &synth->quality_none);
+  fluid_settings_getint(settings, "synth.coalesce-controllers", &synth->coalesce_controllers);
 
   fluid_settings_getint(settings, "synth.polyphony", &synth->polyphony);
   fluid_settings_getnum(settings, "synth.sample-rate", &synth->sample_rate);
@@ -600,6 +646,9 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getnum_float(settings, "synth.gain", &synth->gain);
   fluid_settings_getint(settings, "synth.device-id", &synth->device_id);
   fluid_settings_getint(settings, "synth.cpu-cores", &synth->cores);
+  fluid_settings_getint(settings, "synth.block-size", &synth->block_size);
+  fluid_settings_getint(settings, "synth.cpu-budget", &synth->cpu_budget);
+  synth->cpu_voice_limit = 65535;
 
   fluid_settings_getnum_float(settings, "synth.overflow.percussion", &synth->overflow.percussion);
   fluid_settings_getnum_float(settings, "synth.overflow.released", &synth->overflow.released);
@@ -617,6 +666,16 @@ new_fluid_synth(fluid_settings_t *settings)
 			      fluid_synth_handle_polyphony, synth);
   fluid_settings_callback_int(settings, "synth.device-id",
                               fluid_synth_handle_device_id, synth);
+  fluid_settings_callback_int(settings, "synth.cpu-budget",
+                              fluid_synth_handle_cpu_budget, synth);
+  fluid_settings_callback_int(settings, "synth.coalesce-controllers",
+                              fluid_synth_handle_coalesce_controllers, synth);
+  fluid_settings_callback_int(settings, "synth.dynamic-quality.active",
+                              fluid_synth_handle_dynamic_quality, synth);
+  fluid_settings_callback_num(settings, "synth.dynamic-quality.linear",
+                              fluid_synth_handle_quality_level, synth);
+  fluid_settings_callback_num(settings, "synth.dynamic-quality.none",
+                              fluid_synth_handle_quality_level, synth);
   fluid_settings_callback_num(settings, "synth.overflow.percussion",
                               fluid_synth_handle_overflow, synth);
   fluid_settings_callback_num(settings, "synth.overflow.sustained",
@@ -690,6 +749,7 @@ new_fluid_synth(fluid_settings_t *settings)
   synth->state = FLUID_SYNTH_PLAYING;
   synth->sfont_info = NULL;
   synth->sfont_hash = new_fluid_hashtable (NULL, NULL);
+  synth->preset_cache = new_fluid_hashtable (NULL, NULL);
   synth->noteid = 0;
   
   synth->fromkey_portamento = INVALID_NOTE;		/* disable portamento */
@@ -702,7 +762,8 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getint(settings, "synth.parallel-render", &i);
   /* In an overflow situation, a new voice takes about 50 spaces in the queue! */
   synth->eventhandler = new_fluid_rvoice_eventhandler(i, synth->polyphony*64,
-	synth->polyphony, nbuf, synth->effects_channels, synth->sample_rate);
+	synth->polyphony, nbuf, synth->effects_channels, synth->sample_rate,
+	synth->block_size);
 
   if (synth->eventhandler == NULL)
     goto error_recovery; 
@@ -727,7 +788,7 @@ new_fluid_synth(fluid_settings_t *settings)
   if (with_ladspa) {
 #ifdef LADSPA
     synth->ladspa_fx = new_fluid_ladspa_fx(synth->sample_rate,
-            FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE);
+            FLUID_MIXER_MAX_SAMPLES_DEFAULT);
     if(synth->ladspa_fx == NULL) {
       FLUID_LOG(FLUID_ERR, "Out of memory");
       goto error_recovery;
@@ -761,18 +822,24 @@ new_fluid_synth(fluid_settings_t *settings)
     }
   }
 
-  /* allocate all synthesis processes */
-  synth->nvoice = synth->polyphony;
-  synth->voice = FLUID_ARRAY(fluid_voice_t*, synth->nvoice);
-  if (synth->voice == NULL) {
+  /* allocate the output buffer tables used by fluid_synth_process(), so
+   * that no memory allocation happens in the audio callback */
+  synth->process_left = FLUID_ARRAY(float*, synth->audio_channels);
+  synth->process_right = FLUID_ARRAY(float*, synth->audio_channels);
+  synth->process_fx_left = FLUID_ARRAY(float*, synth->effects_channels);
+  synth->process_fx_right = FLUID_ARRAY(float*, synth->effects_channels);
+  if (synth->process_left == NULL || synth->process_right == NULL
+      || synth->process_fx_left == NULL || synth->process_fx_right == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
     goto error_recovery;
   }
-  for (i = 0; i < synth->nvoice; i++) {
-    synth->voice[i] = new_fluid_voice(synth->sample_rate);
-    if (synth->voice[i] == NULL) {
-      goto error_recovery;
-    }
-  }
+
+  /* the synthesis processes are allocated as they are needed, see
+   * fluid_synth_add_voice_chunk_LOCAL() */
+  synth->nvoice = 0;
+  synth->voice = NULL;
+  synth->voice_chunks = NULL;
+  synth->voice_memory = 0;
 
   /* sets a default basic channel */
   /* Sets one basic channel: basic channel 0, mode 0 (Omni On - Poly) */
@@ -786,8 +853,9 @@ new_fluid_synth(fluid_settings_t *settings)
 			   synth->polyphony, 0.0f);
   fluid_synth_set_reverb_on(synth, synth->with_reverb);
   fluid_synth_set_chorus_on(synth, synth->with_chorus);
+  fluid_synth_update_dynamic_quality_LOCAL(synth);
 				 
-  synth->cur = FLUID_BUFSIZE;
+  synth->cur = synth->block_size;
   synth->curmax = 0;
   synth->dither_index = 0;
 
@@ -856,6 +924,9 @@ delete_fluid_synth(fluid_synth_t* synth)
 
   fluid_profiling_print();
 
+  /* wait for the SoundFonts that are still being loaded */
+  fluid_synth_cleanup_sfload_requests(synth, TRUE);
+
   /* turn off all voices, needed to unload SoundFont data */
   if (synth->voice != NULL) {
     for (i = 0; i < synth->nvoice; i++) {
@@ -898,6 +969,7 @@ delete_fluid_synth(fluid_synth_t* synth)
 
   /* Delete the SoundFont info hash */
   delete_fluid_hashtable (synth->sfont_hash);
+  delete_fluid_hashtable (synth->preset_cache);
 
 
   /* delete all the SoundFont loaders */
@@ -917,12 +989,16 @@ delete_fluid_synth(fluid_synth_t* synth)
     FLUID_FREE(synth->channel);
   }
 
-  if (synth->voice != NULL) {
-    for (i = 0; i < synth->nvoice; i++) {
-	delete_fluid_voice(synth->voice[i]);
-    }
-    FLUID_FREE(synth->voice);
+  FLUID_FREE(synth->voice);
+  for (list = synth->voice_chunks; list; list = fluid_list_next(list)) {
+    FLUID_FREE(fluid_list_get(list));
   }
+  delete_fluid_list(synth->voice_chunks);
+
+  FLUID_FREE(synth->process_left);
+  FLUID_FREE(synth->process_right);
+  FLUID_FREE(synth->process_fx_left);
+  FLUID_FREE(synth->process_fx_right);
 
 
   /* free the tunings, if any */
@@ -998,6 +1074,50 @@ fluid_synth_noteon(fluid_synth_t* synth, int chan, int key, int vel)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Send a note-on event to a FluidSynth object, starting the note at an exact
+ * audio frame.
+ * @param synth FluidSynth instance
+ * @param frame_offset Number of audio frames from the start of the next
+ *   block being synthesized until the note starts sounding (>= 0)
+ * @param chan MIDI channel number (0 to MIDI channel count - 1)
+ * @param key MIDI note number (0-127)
+ * @param vel MIDI velocity (0-127, 0=noteoff)
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ *
+ * Unlike fluid_synth_noteon(), which takes effect at the next block boundary
+ * (see fluid_synth_get_internal_bufsize()), the voices of this note begin
+ * exactly \c frame_offset frames into the rendered audio. Offsets larger
+ * than one block delay the note over several blocks.
+ *
+ * The offset is counted from the next block that will be synthesized. When
+ * rendering with fluid_synth_write_float() and friends, requesting multiples
+ * of the internal block size keeps these blocks aligned with the buffers
+ * passed in, so that \c frame_offset is the frame index within the
+ * next buffer. fluid_synth_render_direct() is always aligned.
+ *
+ * @note Legato note changes on a monophonic channel reuse the already
+ * sounding voices and are applied at the block boundary.
+ * @since 2.0.0
+ */
+int
+fluid_synth_noteon_at(fluid_synth_t* synth, int frame_offset, int chan, int key, int vel)
+{
+  int result;
+  fluid_return_val_if_fail (frame_offset >= 0, FLUID_FAILED);
+  fluid_return_val_if_fail (key >= 0 && key <= 127, FLUID_FAILED);
+  fluid_return_val_if_fail (vel >= 0 && vel <= 127, FLUID_FAILED);
+  FLUID_API_ENTRY_CHAN(FLUID_FAILED);
+  
+  /* Allowed only on MIDI channel enabled */
+  FLUID_API_RETURN_IF_CHAN_DISABLED(FLUID_FAILED);
+
+  synth->noteon_offset = frame_offset;
+  result = fluid_synth_noteon_LOCAL (synth, chan, key, vel);
+  synth->noteon_offset = 0;
+  FLUID_API_RETURN(result);
+}
+
 /* Local synthesis thread variant of fluid_synth_noteon */
 static int
 fluid_synth_noteon_LOCAL(fluid_synth_t* synth, int chan, int key, int vel)
@@ -1106,12 +1226,10 @@ fluid_synth_damp_voices_by_sustain_LOCAL(fluid_synth_t* synth, int chan)
 {
   fluid_channel_t* channel = synth->channel[chan];
   fluid_voice_t* voice;
-  int i;
 
-  for (i = 0; i < synth->polyphony; i++)
+  for (voice = channel->voices; voice != NULL; voice = voice->chan_next)
   {
-    voice = synth->voice[i];
-    if ((fluid_voice_get_channel(voice) == chan) && fluid_voice_is_sustained(voice))                                                                                                                                                                                 
+    if (fluid_voice_is_sustained(voice))                                                                                                                                                                                 
     {
        if(voice->key == channel->key_mono_sustained)
        {
@@ -1133,13 +1251,10 @@ fluid_synth_damp_voices_by_sostenuto_LOCAL(fluid_synth_t* synth, int chan)
 {
   fluid_channel_t* channel = synth->channel[chan];
   fluid_voice_t* voice;
-  int i;
 
-  for (i = 0; i < synth->polyphony; i++)
+  for (voice = channel->voices; voice != NULL; voice = voice->chan_next)
   {
-    voice = synth->voice[i];
-
-    if ((fluid_voice_get_channel(voice) == chan) && fluid_voice_is_sostenuto(voice))                                                                                                                                                                         
+    if (fluid_voice_is_sostenuto(voice))                                                                                                                                                                         
     {
         if(voice->key == channel->key_mono_sustained)
         {
@@ -1537,6 +1652,94 @@ fluid_synth_handle_device_id (void *data, const char *name, int value)
   fluid_synth_api_exit(synth);
 }
 
+/*
+ * Handler for synth.cpu-budget setting.
+ */
+static void
+fluid_synth_handle_cpu_budget (void *data, const char *name, int value)
+{
+  fluid_synth_t *synth = (fluid_synth_t *)data;
+  fluid_return_if_fail(synth != NULL);
+
+  fluid_synth_api_enter(synth);
+  fluid_atomic_int_set(&synth->cpu_budget, value);
+  /* start over, the governor lowers the limit again if needed */
+  fluid_atomic_int_set(&synth->cpu_voice_limit, 65535);
+  fluid_synth_api_exit(synth);
+}
+
+/*
+ * Handler for synth.coalesce-controllers setting.
+ */
+static void
+fluid_synth_handle_coalesce_controllers (void *data, const char *name, int value)
+{
+  fluid_synth_t *synth = (fluid_synth_t *)data;
+  fluid_return_if_fail(synth != NULL);
+
+  fluid_synth_api_enter(synth);
+  /* updates that are still pending are applied with the next block */
+  synth->coalesce_controllers = value;
+  fluid_synth_api_exit(synth);
+}
+
+/*
+ * Handler for synth.dynamic-quality.active setting.
+ */
+static void
+fluid_synth_handle_dynamic_quality (void *data, const char *name, int value)
+{
+  fluid_synth_t *synth = (fluid_synth_t *)data;
+  fluid_return_if_fail(synth != NULL);
+
+  fluid_synth_api_enter(synth);
+  synth->with_dynamic_quality = value;
+  fluid_synth_update_dynamic_quality_LOCAL(synth);
+  fluid_synth_api_exit(synth);
+}
+
+/*
+ * Handler for synth.dynamic-quality.linear and synth.dynamic-quality.none
+ * settings.
+ */
+static void
+fluid_synth_handle_quality_level (void *data, const char *name, double value)
+{
+  fluid_synth_t *synth = (fluid_synth_t *)data;
+  fluid_return_if_fail(synth != NULL);
+
+  fluid_synth_api_enter(synth);
+
+  if (FLUID_STRCMP(name, "synth.dynamic-quality.linear") == 0) {
+    synth->quality_linear = value;
+  }
+  else if (FLUID_STRCMP(name, "synth.dynamic-quality.none") == 0) {
+    synth->quality_none = value;
+  }
+  fluid_synth_update_dynamic_quality_LOCAL(synth);
+
+  fluid_synth_api_exit(synth);
+}
+
+/*
+ * Hand the dynamic quality thresholds to the mixer, which passes them to
+ * every voice it adds. The levels are converted from dB to amplitudes.
+ */
+static void
+fluid_synth_update_dynamic_quality_LOCAL(fluid_synth_t* synth)
+{
+  fluid_real_t linear_amp = 0.0f, none_amp = 0.0f;
+
+  if (synth->with_dynamic_quality) {
+    linear_amp = pow(10.0, synth->quality_linear / 20.0);
+    none_amp = pow(10.0, synth->quality_none / 20.0);
+  }
+  fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_quality_level,
+                           FLUID_INTERP_LINEAR, linear_amp);
+  fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_quality_level,
+                           FLUID_INTERP_NONE, none_amp);
+}
+
 /**
  * Process a MIDI SYSEX (system exclusive) message.
  * @param synth FluidSynth instance
@@ -1845,7 +2048,7 @@ fluid_synth_all_notes_off_LOCAL(fluid_synth_t* synth, int chan)
   fluid_voice_t* voice;
   int i;
 
-  for (i = 0; i < synth->polyphony; i++) {
+  for (i = 0; i < synth->nvoice; i++) {
     voice = synth->voice[i];
 
     if (fluid_voice_is_playing(voice) && ((-1 == chan) || (chan == fluid_voice_get_channel(voice))))
@@ -1886,7 +2089,7 @@ fluid_synth_all_sounds_off_LOCAL(fluid_synth_t* synth, int chan)
   fluid_voice_t* voice;
   int i;
 
-  for (i = 0; i < synth->polyphony; i++) {
+  for (i = 0; i < synth->nvoice; i++) {
     voice = synth->voice[i];
 
     if (fluid_voice_is_playing(voice) && ((-1 == chan) || (chan == fluid_voice_get_channel(voice))))
@@ -1972,14 +2175,15 @@ static int
 fluid_synth_modulate_voices_LOCAL(fluid_synth_t* synth, int chan, int is_cc, int ctrl)
 {
   fluid_voice_t* voice;
-  int i;
 
-  for (i = 0; i < synth->polyphony; i++) {
-    voice = synth->voice[i];
-
-    if (fluid_voice_get_channel(voice) == chan)
-      fluid_voice_modulate(voice, is_cc, ctrl);
+  if (synth->coalesce_controllers) {
+    fluid_synth_defer_modulation_LOCAL(synth, chan, synth->channel[chan]->pending_mod,
+                                       is_cc ? ctrl : 128 + ctrl);
+    return FLUID_OK;
   }
+
+  for (voice = synth->channel[chan]->voices; voice != NULL; voice = voice->chan_next)
+    fluid_voice_modulate(voice, is_cc, ctrl);
   return FLUID_OK;
 }
 
@@ -1993,15 +2197,91 @@ static int
 fluid_synth_modulate_voices_all_LOCAL(fluid_synth_t* synth, int chan)
 {
   fluid_voice_t* voice;
-  int i;
 
-  for (i = 0; i < synth->polyphony; i++) {
-    voice = synth->voice[i];
+  for (voice = synth->channel[chan]->voices; voice != NULL; voice = voice->chan_next)
+    fluid_voice_modulate_all(voice);
+  return FLUID_OK;
+}
 
-    if (fluid_voice_get_channel(voice) == chan)
-      fluid_voice_modulate_all(voice);
+/*
+ * Record a controller update of the voices of a channel, instead of
+ * applying it right away. Only the value the controller has when the next
+ * block is rendered is audible, so further updates of the same controller
+ * collapse into the pending one (see fluid_synth_apply_pending_modulations()).
+ */
+static void
+fluid_synth_defer_modulation_LOCAL(fluid_synth_t* synth, int chan,
+                                   unsigned int* pending, int bit)
+{
+  unsigned int mask = 1u << (bit % 32);
+
+  synth->coalesce_updates++;
+  if (pending[bit / 32] & mask) {
+    synth->coalesce_collapsed++;
+    return;
   }
-  return FLUID_OK;
+  pending[bit / 32] |= mask;
+  synth->channel[chan]->has_pending = TRUE;
+  fluid_atomic_int_set(&synth->coalesce_pending, TRUE);
+}
+
+/*
+ * Apply the controller updates deferred by
+ * fluid_synth_defer_modulation_LOCAL() to the voices. Called by the
+ * rendering thread before a block is rendered. If another thread is in the
+ * public API, the updates are left pending for the next block, rendering
+ * must not wait for a long-running API call.
+ */
+static void
+fluid_synth_apply_pending_modulations(fluid_synth_t* synth)
+{
+  fluid_channel_t* channel;
+  fluid_voice_t* voice;
+  unsigned int bits;
+  int i, k, n;
+
+  if (!fluid_atomic_int_get(&synth->coalesce_pending)) {
+    return;
+  }
+
+  if (!fluid_synth_api_try_enter(synth)) {
+    return;
+  }
+  fluid_atomic_int_set(&synth->coalesce_pending, FALSE);
+
+  for (i = 0; i < synth->midi_channels; i++) {
+    channel = synth->channel[i];
+    if (!channel->has_pending) {
+      continue;
+    }
+    channel->has_pending = FALSE;
+
+    for (k = 0; k < 8; k++) {
+      bits = channel->pending_mod[k];
+      channel->pending_mod[k] = 0;
+      for (n = k * 32; bits != 0; n++, bits >>= 1) {
+        if (bits & 1) {
+          for (voice = channel->voices; voice != NULL; voice = voice->chan_next) {
+            fluid_voice_modulate(voice, n < 128, n & 127);
+          }
+        }
+      }
+    }
+
+    for (k = 0; k < 4; k++) {
+      bits = channel->pending_key_pressure[k];
+      channel->pending_key_pressure[k] = 0;
+      for (n = k * 32; bits != 0; n++, bits >>= 1) {
+        if (bits & 1) {
+          for (voice = channel->key_voices[n]; voice != NULL; voice = voice->key_next) {
+            fluid_voice_modulate(voice, 0, FLUID_MOD_KEYPRESSURE);
+          }
+        }
+      }
+    }
+  }
+
+  fluid_synth_api_exit(synth);
 }
 
 /**
@@ -2073,17 +2353,18 @@ static int
 fluid_synth_update_key_pressure_LOCAL(fluid_synth_t* synth, int chan, int key)
 {
   fluid_voice_t* voice;
-  int i;
   int result = FLUID_OK;
 
-  for (i = 0; i < synth->polyphony; i++) {
-    voice = synth->voice[i];
+  if (synth->coalesce_controllers) {
+    fluid_synth_defer_modulation_LOCAL(synth, chan, synth->channel[chan]->pending_key_pressure, key);
+    return FLUID_OK;
+  }
 
-    if (voice->chan == chan && voice->key == key) {
-      result = fluid_voice_modulate(voice, 0, FLUID_MOD_KEYPRESSURE);
-      if (result != FLUID_OK)
-        return result;
-    }
+  for (voice = synth->channel[chan]->key_voices[key]; voice != NULL;
+       voice = voice->key_next) {
+    result = fluid_voice_modulate(voice, 0, FLUID_MOD_KEYPRESSURE);
+    if (result != FLUID_OK)
+      return result;
   }
   return result;
 }
@@ -2283,9 +2564,31 @@ fluid_synth_get_preset_by_sfont_name(fluid_synth_t* synth, const char *sfontname
   return preset;
 }
 
+/* The key of a bank and program number in the preset cache */
+#define FLUID_PRESET_CACHE_KEY(_bank, _prog)  FLUID_INT_TO_POINTER((int) (((_bank) << 8) | (_prog)))
+
+/* Forget which SoundFonts provide which presets, after the SoundFont stack
+ * or a bank offset changed */
+static void
+fluid_synth_invalidate_preset_cache(fluid_synth_t* synth)
+{
+  fluid_hashtable_remove_all (synth->preset_cache);
+}
+
+/* Do the presets of a SoundFont never change while it is loaded? Only
+ * known for the default loader, a RAM SoundFont gets new presets at any
+ * time, for instance. */
+#define FLUID_SFONT_HAS_FIXED_PRESETS(_sfont) \
+  ((_sfont)->get_preset == fluid_defsfont_sfont_get_preset)
+
 /* Find a preset by bank and program numbers.
  * Returns preset pointer or NULL.
  *
+ * The SoundFont found for a bank and program number is cached, so that
+ * program changes don't search the SoundFont stack again. A SoundFont is
+ * only cached if the presets of all SoundFonts above it on the stack are
+ * fixed, so that none of them can get a preset hiding the cached one.
+ *
  * @note The returned preset has been allocated, caller owns it and should
  *       free it when finished using it. */
 fluid_preset_t*
@@ -2295,6 +2598,23 @@ fluid_synth_find_preset(fluid_synth_t* synth, unsigned int banknum,
   fluid_preset_t *preset = NULL;
   fluid_sfont_info_t *sfont_info;
   fluid_list_t *list;
+  int cacheable = (banknum <= 0xffff) && (prognum <= 0xff);
+
+  if (cacheable)
+  {
+    sfont_info = fluid_hashtable_lookup (synth->preset_cache,
+                                         FLUID_PRESET_CACHE_KEY (banknum, prognum));
+    if (sfont_info)
+    {
+      preset = fluid_sfont_get_preset (sfont_info->sfont,
+                                       banknum - sfont_info->bankofs, prognum);
+      if (preset)
+      {
+        sfont_info->refcount++;       /* Add reference to SoundFont */
+        return preset;
+      }
+    }
+  }
 
   for (list = synth->sfont_info; list; list = fluid_list_next (list)) {
     sfont_info = (fluid_sfont_info_t *)fluid_list_get (list);
@@ -2304,8 +2624,15 @@ fluid_synth_find_preset(fluid_synth_t* synth, unsigned int banknum,
     if (preset)
     {
       sfont_info->refcount++;       /* Add reference to SoundFont */
+
+      if (cacheable)
+        fluid_hashtable_insert (synth->preset_cache,
+                                FLUID_PRESET_CACHE_KEY (banknum, prognum), sfont_info);
       break;
     }
+
+    if (!FLUID_SFONT_HAS_FIXED_PRESETS (sfont_info->sfont))
+      cacheable = FALSE;
   }
 
   return preset;
@@ -2636,7 +2963,7 @@ fluid_synth_set_sample_rate(fluid_synth_t* synth, float sample_rate)
   fluid_settings_getint(synth->settings, "synth.min-note-length", &i);
   synth->min_note_length_ticks = (unsigned int) (i*synth->sample_rate/1000.0f);
   
-  for (i=0; i < synth->polyphony; i++)
+  for (i=0; i < synth->nvoice; i++)
     fluid_voice_set_output_rate(synth->voice[i], sample_rate);
   fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_samplerate, 
 			   0, sample_rate);
@@ -2680,7 +3007,7 @@ fluid_synth_update_gain_LOCAL(fluid_synth_t* synth)
 
   gain = synth->gain;
 
-  for (i = 0; i < synth->polyphony; i++)
+  for (i = 0; i < synth->nvoice; i++)
   {
     voice = synth->voice[i];
     if (fluid_voice_is_playing(voice)) fluid_voice_set_gain (voice, gain);
@@ -2740,30 +3067,21 @@ fluid_synth_update_polyphony_LOCAL(fluid_synth_t* synth, int new_polyphony)
   fluid_voice_t *voice;
   int i;
 
-  if (new_polyphony > synth->nvoice) {
-    /* Create more voices */
-    fluid_voice_t** new_voices = FLUID_REALLOC(synth->voice, 
-					       sizeof(fluid_voice_t*) * new_polyphony);
-    if (new_voices == NULL) 
-      return FLUID_FAILED;
-    synth->voice = new_voices;
-    for (i = synth->nvoice; i < new_polyphony; i++) {
-      synth->voice[i] = new_fluid_voice(synth->sample_rate);
-      if (synth->voice[i] == NULL) 
-	return FLUID_FAILED;
-    
-      fluid_voice_set_custom_filter(synth->voice[i], synth->custom_filter_type, synth->custom_filter_flags);
-    }
-    synth->nvoice = new_polyphony;
-  }
-  
+  /* more voices are allocated when they are needed */
   synth->polyphony = new_polyphony;
+  for (i = 0; i < synth->polyphony && i < synth->nvoice; i++)
+    synth->voice[i]->above_polyphony = FALSE;
+
   /* turn off any voices above the new limit */
   for (i = synth->polyphony; i < synth->nvoice; i++)
   {
     voice = synth->voice[i];
     if (fluid_voice_is_playing(voice)) fluid_voice_off (voice);
+    /* they finish by themselves and must neither be stolen nor reused */
+    fluid_voice_steal_remove(voice);
+    voice->above_polyphony = TRUE;
   }
+  fluid_synth_init_free_voices_LOCAL(synth);
 
   fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_polyphony, 
 			   synth->polyphony, 0.0f);
@@ -2771,6 +3089,85 @@ fluid_synth_update_polyphony_LOCAL(fluid_synth_t* synth, int new_polyphony)
   return FLUID_OK;
 }
 
+/* Re-sort the playing voices into their overflow buckets, after something
+ * changed which the buckets depend on. */
+static void
+fluid_synth_update_steal_buckets_LOCAL(fluid_synth_t* synth)
+{
+  int i;
+
+  for (i = 0; i < synth->nvoice; i++)
+    fluid_voice_steal_update(synth->voice[i]);
+}
+
+/*
+ * Allocate another chunk of synthesis processes, but no more than the
+ * polyphony allows, and add them to the list of available voices. The
+ * voices are kept until the synth is deleted.
+ */
+static int
+fluid_synth_add_voice_chunk_LOCAL(fluid_synth_t* synth)
+{
+  fluid_voice_storage_t* chunk;
+  fluid_voice_t** new_voices;
+  int i, count = synth->polyphony - synth->nvoice;
+
+  if (count <= 0) {
+    return FLUID_FAILED;
+  }
+  if (count > FLUID_VOICE_CHUNK_SIZE) {
+    count = FLUID_VOICE_CHUNK_SIZE;
+  }
+
+  new_voices = FLUID_REALLOC(synth->voice,
+                             sizeof(fluid_voice_t*) * (synth->nvoice + count));
+  if (new_voices == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  synth->voice = new_voices;
+
+  chunk = FLUID_ARRAY(fluid_voice_storage_t, count);
+  if (chunk == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  synth->voice_chunks = fluid_list_prepend(synth->voice_chunks, chunk);
+  synth->voice_memory += count * sizeof(fluid_voice_storage_t);
+
+  for (i = 0; i < count; i++) {
+    fluid_voice_setup(&chunk[i].voice, &chunk[i].rvoice, &chunk[i].overflow_rvoice,
+                      synth->sample_rate, synth->block_size);
+    fluid_voice_set_custom_filter(&chunk[i].voice, synth->custom_filter_type,
+                                  synth->custom_filter_flags);
+    synth->voice[synth->nvoice + i] = &chunk[i].voice;
+  }
+  synth->nvoice += count;
+
+  /* lowest voice index first, see fluid_synth_init_free_voices_LOCAL() */
+  for (i = count - 1; i >= 0; i--) {
+    fluid_voice_free_list_add(&synth->free_voice, &chunk[i].voice);
+  }
+  return FLUID_OK;
+}
+
+/* (Re)build the list of available voices. Only voices below the polyphony
+ * limit are listed, the lowest voice index is handed out first. */
+static void
+fluid_synth_init_free_voices_LOCAL(fluid_synth_t* synth)
+{
+  int i;
+
+  for (i = 0; i < synth->nvoice; i++)
+    fluid_voice_free_list_remove(&synth->free_voice, synth->voice[i]);
+
+  i = (synth->polyphony < synth->nvoice) ? synth->polyphony : synth->nvoice;
+  for (i--; i >= 0; i--) {
+    if (_AVAILABLE(synth->voice[i]))
+      fluid_voice_free_list_add(&synth->free_voice, synth->voice[i]);
+  }
+}
+
 /**
  * Get current synthesizer polyphony (max number of voices).
  * @param synth FluidSynth instance
@@ -2822,12 +3219,33 @@ fluid_synth_get_active_voice_count(fluid_synth_t* synth)
  * @param synth FluidSynth instance
  * @return Internal buffer size in audio frames.
  *
- * Audio is synthesized this number of frames at a time.  Defaults to 64 frames.
+ * Audio is synthesized this number of frames at a time.  Defaults to 64 frames,
+ * can be changed with the \c synth.block-size setting (since 2.0.0).
  */
 int
 fluid_synth_get_internal_bufsize(fluid_synth_t* synth)
 {
-  return FLUID_BUFSIZE;
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  return synth->block_size;
+}
+
+/*
+ * Get the number of audio frames, not more than len, that fluid_synth_write_*()
+ * can output so that the frame following them is the first one of a newly
+ * synthesized block. Frames already synthesized but not output yet are
+ * always included. Must be called from the synthesis thread.
+ */
+int
+fluid_synth_get_aligned_frames(fluid_synth_t* synth, int len)
+{
+  int pending = synth->curmax - synth->cur;
+
+  if (pending < 0)
+    pending = 0;
+  if (len <= pending)
+    return len;
+
+  return pending + (len - pending) / synth->block_size * synth->block_size;
 }
 
 /**
@@ -2852,6 +3270,32 @@ fluid_synth_program_reset(fluid_synth_t* synth)
   FLUID_API_RETURN(FLUID_OK);
 }
 
+/*
+ * Copy 'num' frames starting at 'offset' of the internal mixer buffers 'in'
+ * to position 'count' of the 'nbuf' caller supplied buffers 'out', converting
+ * them to float if necessary. NULL entries in 'out' are skipped.
+ */
+static FLUID_INLINE void
+fluid_synth_copy_bufs(float** out, fluid_real_t** in, int nbuf,
+                      int count, int offset, int num)
+{
+  int i;
+#ifndef WITH_FLOAT
+  int j;
+#endif
+
+  for (i = 0; i < nbuf; i++) {
+    if (out[i] == NULL)
+      continue;
+#ifdef WITH_FLOAT
+    FLUID_MEMCPY(out[i] + count, in[i] + offset, num * sizeof(float));
+#else //WITH_FLOAT
+    for (j = 0; j < num; j++)
+      out[i][j + count] = (float) in[i][j + offset];
+#endif //WITH_FLOAT
+  }
+}
+
 /**
  * Synthesize a block of floating point audio to separate audio buffers (multichannel rendering). First effect channel used by reverb, second for chorus.
  * @param synth FluidSynth instance
@@ -2863,6 +3307,8 @@ fluid_synth_program_reset(fluid_synth_t* synth)
  * @return #FLUID_OK on success, #FLUID_FAILED otherwise
  *
  * @note Should only be called from synthesis thread.
+ * @note Since 2.0.0: Individual buffers within \c left, \c right, \c fx_left and \c fx_right
+ * may be \c NULL, in which case the corresponding channel is rendered but not copied.
  * 
  * Usage example:
  * @code
@@ -2908,10 +3354,7 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   fluid_real_t** left_in, **fx_left_in;
   fluid_real_t** right_in, **fx_right_in;
   double time = fluid_utime();
-  int i, num, available, count;
-#ifdef WITH_FLOAT
-  int bytes;
-#endif
+  int num, available, count;
   float cpu_load;
 
   if (!synth->eventhandler->is_threadsafe)
@@ -2920,50 +3363,21 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   /* First, take what's still available in the buffer */
   count = 0;
   num = synth->cur;
-  if (synth->cur < FLUID_BUFSIZE) {
-    available = FLUID_BUFSIZE - synth->cur;
+  if (synth->cur < synth->curmax) {
+    available = synth->curmax - synth->cur;
     fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
     fluid_rvoice_mixer_get_fx_bufs(synth->eventhandler->mixer, &fx_left_in, &fx_right_in);
 
     num = (available > len)? len : available;
-#ifdef WITH_FLOAT
-    bytes = num * sizeof(float);
-#endif
 
-    for (i = 0; i < synth->audio_channels; i++) {
-#ifdef WITH_FLOAT
-      FLUID_MEMCPY(left[i], left_in[i] + synth->cur, bytes);
-      FLUID_MEMCPY(right[i], right_in[i] + synth->cur, bytes);
-#else //WITH_FLOAT
-      int j;
-      for (j = 0; j < num; j++) {
-          left[i][j] = (float) left_in[i][j + synth->cur];
-          right[i][j] = (float) right_in[i][j + synth->cur];
-      }
-#endif //WITH_FLOAT
-    }
-    
-    for (i = 0; i < synth->effects_channels; i++)
-    {
-#ifdef WITH_FLOAT
-      if(fx_left != NULL)
-        FLUID_MEMCPY(fx_left[i], fx_left_in[i] + synth->cur, bytes);
-      
-      if(fx_right != NULL)
-        FLUID_MEMCPY(fx_right[i], fx_right_in[i] + synth->cur, bytes);
-#else //WITH_FLOAT
-      int j;
-      if(fx_left != NULL) {
-        for (j = 0; j < num; j++)
-          fx_left[i][j] = (float) fx_left_in[i][j + synth->cur];
-      }
-      
-      if(fx_right != NULL) {
-        for (j = 0; j < num; j++)
-          fx_right[i][j] = (float) fx_right_in[i][j + synth->cur];
-      }
-#endif //WITH_FLOAT
-    }
+    fluid_synth_copy_bufs(left, left_in, synth->audio_channels, 0, synth->cur, num);
+    fluid_synth_copy_bufs(right, right_in, synth->audio_channels, 0, synth->cur, num);
+
+    if (fx_left != NULL)
+      fluid_synth_copy_bufs(fx_left, fx_left_in, synth->effects_channels, 0, synth->cur, num);
+
+    if (fx_right != NULL)
+      fluid_synth_copy_bufs(fx_right, fx_right_in, synth->effects_channels, 0, synth->cur, num);
     
     count += num;
     num += synth->cur; /* if we're now done, num becomes the new synth->cur below */
@@ -2972,49 +3386,20 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   /* Then, run one_block() and copy till we have 'len' samples  */
   while (count < len) {
     fluid_rvoice_mixer_set_mix_fx(synth->eventhandler->mixer, 0);
-    fluid_synth_render_blocks(synth, 1); // TODO: 
+    synth->curmax = synth->block_size * fluid_synth_render_blocks(synth, 1); // TODO: 
     fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
     fluid_rvoice_mixer_get_fx_bufs(synth->eventhandler->mixer, &fx_left_in, &fx_right_in);
 
-    num = (FLUID_BUFSIZE > len - count)? len - count : FLUID_BUFSIZE;
-#ifdef WITH_FLOAT
-    bytes = num * sizeof(float);
-#endif
+    num = (synth->curmax > len - count)? len - count : synth->curmax;
 
-    for (i = 0; i < synth->audio_channels; i++) {
-#ifdef WITH_FLOAT
-      FLUID_MEMCPY(left[i] + count, left_in[i], bytes);
-      FLUID_MEMCPY(right[i] + count, right_in[i], bytes);
-#else //WITH_FLOAT
-      int j;
-      for (j = 0; j < num; j++) {
-          left[i][j + count] = (float) left_in[i][j];
-          right[i][j + count] = (float) right_in[i][j];
-      }
-#endif //WITH_FLOAT
-    }
+    fluid_synth_copy_bufs(left, left_in, synth->audio_channels, count, 0, num);
+    fluid_synth_copy_bufs(right, right_in, synth->audio_channels, count, 0, num);
 
-    for (i = 0; i < synth->effects_channels; i++)
-    {
-#ifdef WITH_FLOAT
-      if(fx_left != NULL)
-        FLUID_MEMCPY(fx_left[i] + count, fx_left_in[i], bytes);
-      
-      if(fx_right != NULL)
-        FLUID_MEMCPY(fx_right[i] + count, fx_right_in[i], bytes);
-#else //WITH_FLOAT
-      int j;
-      if(fx_left != NULL) {
-        for (j = 0; j < num; j++)
-          fx_left[i][j + count] = (float) fx_left_in[i][j];
-      }
-      
-      if(fx_right != NULL) {
-        for (j = 0; j < num; j++)
-          fx_right[i][j + count] = (float) fx_right_in[i][j];
-      }
-#endif //WITH_FLOAT
-    }
+    if (fx_left != NULL)
+      fluid_synth_copy_bufs(fx_left, fx_left_in, synth->effects_channels, count, 0, num);
+
+    if (fx_right != NULL)
+      fluid_synth_copy_bufs(fx_right, fx_right_in, synth->effects_channels, count, 0, num);
 
     count += num;
   }
@@ -3042,39 +3427,128 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
  * @return #FLUID_OK on success, #FLUID_FAILED otherwise
  *
  * This function implements the default interface defined in fluidsynth/audio.h.
+ *
+ * If \c nout is 2, reverb and chorus are mixed to the stereo output. Otherwise
+ * \c out is interpreted as left/right pairs of the \c synth.audio-channels
+ * followed by left/right pairs of the \c synth.effects-channels (first reverb,
+ * second chorus). Channels which are not covered by \c out are not copied,
+ * surplus arrays in \c out are filled with silence.
  * 
  * @note Should only be called from synthesis thread.
- */
-/*
- * FIXME: Currently if nout != 2 memory allocation will occur!
+ * @note Since 2.0.0 no memory allocation occurs if \c nout != 2.
  */
 int
 fluid_synth_process(fluid_synth_t* synth, int len, int nin, float** in,
                     int nout, float** out)
 {
+  int i, k, nmapped;
+
   if (nout==2) {
     return fluid_synth_write_float(synth, len, out[0], 0, 1, out[1], 0, 1);
   }
-  else {
-    float **left, **right;
-    int i;
-    left = FLUID_ARRAY(float*, nout/2);
-    right = FLUID_ARRAY(float*, nout/2);
-    if ((left == NULL) || (right == NULL)) {
-      FLUID_LOG(FLUID_ERR, "Out of memory.");
-      FLUID_FREE(left);
-      FLUID_FREE(right);
-      return FLUID_FAILED;
-    }
-    for(i=0; i<nout/2; i++) {
-      left[i] = out[2*i];
-      right[i] = out[2*i+1];
-    }
-    fluid_synth_nwrite_float(synth, len, left, right, NULL, NULL);
-    FLUID_FREE(left);
-    FLUID_FREE(right);
-    return FLUID_OK;
+
+  /* Map the stereo pairs of 'out' to the preallocated buffer tables: audio
+   * channels first, then effects channels. */
+  nmapped = nout & ~1;
+  for (i = 0, k = 0; i < synth->audio_channels; i++, k += 2) {
+    synth->process_left[i] = (k < nmapped) ? out[k] : NULL;
+    synth->process_right[i] = (k < nmapped) ? out[k + 1] : NULL;
+  }
+
+  for (i = 0; i < synth->effects_channels; i++, k += 2) {
+    synth->process_fx_left[i] = (k < nmapped) ? out[k] : NULL;
+    synth->process_fx_right[i] = (k < nmapped) ? out[k + 1] : NULL;
+  }
+
+  /* Silence any output the synth has no channel for */
+  if (nmapped > k)
+    nmapped = k;
+  for (i = nmapped; i < nout; i++) {
+    FLUID_MEMSET(out[i], 0, len * sizeof(float));
+  }
+
+  return fluid_synth_nwrite_float(synth, len, synth->process_left, synth->process_right,
+                                  synth->process_fx_left, synth->process_fx_right);
+}
+
+/**
+ * Synthesize audio to the internal buffers of the synth and return them (zero-copy rendering).
+ * @param synth FluidSynth instance
+ * @param blocks Count of internal blocks to synthesize, each fluid_synth_get_internal_bufsize() frames long
+ * @param left Location to store the array of left channel buffers (\c synth.audio-channels in length)
+ * @param right Location to store the array of right channel buffers (\c synth.audio-channels in length)
+ * @param fx_left If not \c NULL, location to store the array of left effect channel buffers
+ *   (\c synth.effects-channels in length). If \c NULL, reverb and chorus are mixed to the
+ *   first audio channel, like fluid_synth_write_float() does.
+ * @param fx_right Location to store the array of right effect channel buffers, must be
+ *   \c NULL if and only if \c fx_left is \c NULL
+ * @return Count of audio frames available in the returned buffers on success (may be less than
+ *   requested, but always a multiple of fluid_synth_get_internal_bufsize()), #FLUID_FAILED otherwise
+ *
+ * Hosts which can read the synthesized audio in place avoid the extra copy done by
+ * fluid_synth_nwrite_float(). The returned buffers are owned by the synth, must not be
+ * modified and stay valid until the next call to any of the synthesis functions.
+ * Audio still buffered from a previous call to fluid_synth_write_float() and friends
+ * is discarded.
+ *
+ * @note Should only be called from synthesis thread.
+ * @note Only available if FluidSynth was compiled with the float sample type
+ *   (\c enable-floats), #FLUID_FAILED is returned otherwise.
+ * @since 2.0.0
+ */
+int
+fluid_synth_render_direct(fluid_synth_t* synth, int blocks,
+                          const float*** left, const float*** right,
+                          const float*** fx_left, const float*** fx_right)
+{
+#ifdef WITH_FLOAT
+  fluid_real_t** left_in, **fx_left_in;
+  fluid_real_t** right_in, **fx_right_in;
+  double time;
+  float cpu_load;
+  int len;
+#endif
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_return_val_if_fail (blocks > 0, FLUID_FAILED);
+  fluid_return_val_if_fail (left != NULL && right != NULL, FLUID_FAILED);
+  fluid_return_val_if_fail ((fx_left == NULL) == (fx_right == NULL), FLUID_FAILED);
+
+#ifdef WITH_FLOAT
+  time = fluid_utime();
+
+  if (!synth->eventhandler->is_threadsafe)
+    fluid_synth_api_enter(synth);
+
+  fluid_rvoice_mixer_set_mix_fx(synth->eventhandler->mixer, fx_left == NULL);
+  len = synth->block_size * fluid_synth_render_blocks(synth, blocks);
+
+  fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
+  *left = (const float**) left_in;
+  *right = (const float**) right_in;
+
+  if (fx_left != NULL) {
+    fluid_rvoice_mixer_get_fx_bufs(synth->eventhandler->mixer, &fx_left_in, &fx_right_in);
+    *fx_left = (const float**) fx_left_in;
+    *fx_right = (const float**) fx_right_in;
   }
+
+  /* Everything rendered has been handed out, make sure fluid_synth_write_*()
+   * won't return any of it again. */
+  synth->cur = synth->curmax = len;
+
+  time = fluid_utime() - time;
+  cpu_load = 0.5 * (fluid_atomic_float_get(&synth->cpu_load) + time * synth->sample_rate / len / 10000.0);
+  fluid_atomic_float_set (&synth->cpu_load, cpu_load);
+
+  if (!synth->eventhandler->is_threadsafe)
+    fluid_synth_api_exit(synth);
+
+  return len;
+#else //WITH_FLOAT
+  FLUID_LOG(FLUID_ERR, "fluid_synth_render_direct() requires FluidSynth to be compiled with float samples");
+  return FLUID_FAILED;
+#endif //WITH_FLOAT
 }
 
 /**
@@ -3120,8 +3594,8 @@ fluid_synth_write_float(fluid_synth_t* synth, int len,
   for (i = 0, j = loff, k = roff; i < len; i++, l++, j += lincr, k += rincr) {
     /* fill up the buffers as needed */
       if (l >= synth->curmax) {
-	int blocksleft = (len-i+FLUID_BUFSIZE-1) / FLUID_BUFSIZE;
-	synth->curmax = FLUID_BUFSIZE * fluid_synth_render_blocks(synth, blocksleft);
+	int blocksleft = (len-i+synth->block_size-1) / synth->block_size;
+	synth->curmax = synth->block_size * fluid_synth_render_blocks(synth, blocksleft);
         fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
 
 	l = 0;
@@ -3230,8 +3704,8 @@ fluid_synth_write_s16(fluid_synth_t* synth, int len,
 
     /* fill up the buffers as needed */
     if (cur >= synth->curmax) { 
-      int blocksleft = (len-i+FLUID_BUFSIZE-1) / FLUID_BUFSIZE;
-      synth->curmax = FLUID_BUFSIZE * fluid_synth_render_blocks(synth, blocksleft);
+      int blocksleft = (len-i+synth->block_size-1) / synth->block_size;
+      synth->curmax = synth->block_size * fluid_synth_render_blocks(synth, blocksleft);
       fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
       cur = 0;
     }
@@ -3324,20 +3798,18 @@ fluid_synth_dither_s16(int *dither_index, int len, float* lin, float* rin,
 static void
 fluid_synth_check_finished_voices(fluid_synth_t* synth)
 {
-  int j;
   fluid_rvoice_t* fv;
+  fluid_voice_t* voice;
   
   while (NULL != (fv = fluid_rvoice_eventhandler_get_finished_voice(synth->eventhandler))) {
-    for (j=0; j < synth->polyphony; j++) {
-      if (synth->voice[j]->rvoice == fv) {
-        fluid_voice_unlock_rvoice(synth->voice[j]);
-        fluid_voice_stop(synth->voice[j]);
-        break;
-      }
-      else if (synth->voice[j]->overflow_rvoice == fv) {
-        fluid_voice_overflow_rvoice_finished(synth->voice[j]);
-        break;
-      }
+    /* each rvoice refers back to the voice owning it */
+    voice = fv->voice;
+    if (voice->rvoice == fv) {
+      fluid_voice_unlock_rvoice(voice);
+      fluid_voice_stop(voice);
+    }
+    else if (voice->overflow_rvoice == fv) {
+      fluid_voice_overflow_rvoice_finished(voice);
     }
   }
 }
@@ -3354,20 +3826,41 @@ void fluid_synth_process_event_queue(fluid_synth_t* synth)
 
 
 /**
- * Process blocks (FLUID_BUFSIZE) of audio.
+ * Process blocks (synth->block_size) of audio.
  * Must be called from renderer thread only!
  * @return number of blocks rendered. Might (often) return less than requested
  */
 static int
 fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
 {
-  int i, maxblocks;
+  int i, maxblocks, still_pending;
+  double time = 0.0;
   fluid_profile_ref_var (prof_ref);
 
+  if (fluid_atomic_int_get(&synth->cpu_budget) > 0) {
+    time = fluid_utime();
+
+    /* The voice governor may have lowered the limit during the last render.
+     * Kill the voices above it now, without waiting for the next API call,
+     * unless another thread is in the API. */
+    if (fluid_synth_api_try_enter(synth)) {
+      fluid_synth_enforce_cpu_voice_limit_LOCAL(synth,
+          fluid_atomic_int_get(&synth->cpu_voice_limit));
+      fluid_synth_api_exit(synth);
+    }
+  }
+
   /* Assign ID of synthesis thread */
 //  synth->synth_thread_id = fluid_thread_get_id ();
 
   fluid_check_fpe("??? Just starting up ???");
+
+  /* controller updates deferred since the last block. If another thread
+   * is in the API they stay pending, the requested blocks are rendered
+   * anyway and the updates are retried at the next block boundary, i.e.
+   * on the next call. */
+  fluid_synth_apply_pending_modulations(synth);
+  still_pending = fluid_atomic_int_get(&synth->coalesce_pending);
   
   fluid_rvoice_eventhandler_dispatch_all(synth->eventhandler);
   
@@ -3378,12 +3871,15 @@ fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
   
   for (i=0; i < blockcount; i++) {
     fluid_sample_timer_process(synth);
-    fluid_synth_add_ticks(synth, FLUID_BUFSIZE);
+    fluid_synth_add_ticks(synth, synth->block_size);
     
     /* If events have been queued waiting for fluid_rvoice_eventhandler_dispatch_all()
-     * (should only happen with parallel render) stop processing and go for rendering
+     * (should only happen with parallel render) or controller updates have
+     * been deferred since this call started, stop processing and go for
+     * rendering
      */
-    if (fluid_rvoice_eventhandler_dispatch_count(synth->eventhandler)) {
+    if (fluid_rvoice_eventhandler_dispatch_count(synth->eventhandler)
+        || (!still_pending && fluid_atomic_int_get(&synth->coalesce_pending))) {
       // Something has happened, we can't process more
       blockcount = i+1;
       break; 
@@ -3401,10 +3897,63 @@ fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
   fluid_check_fpe("??? Remainder of synth_one_block ???");
   fluid_profile(FLUID_PROF_ONE_BLOCK, prof_ref,
                 fluid_rvoice_mixer_get_active_voices(synth->eventhandler->mixer),
-                blockcount * FLUID_BUFSIZE);
+                blockcount * synth->block_size);
+
+  if (time > 0) {
+    fluid_synth_update_cpu_voice_limit(synth, fluid_utime() - time, blockcount);
+  }
   return blockcount;
 }
 
+/*
+ * Voice governor, called by the rendering thread after each render.
+ *
+ * Compares the time spent rendering with the time the rendered audio lasts.
+ * If the synth.cpu-budget is exceeded, the number of voices is limited to
+ * what the budget is expected to allow, so that the lowest priority voices
+ * are killed before an audio deadline is missed. The limit is raised again
+ * slowly once the load is well below the budget.
+ */
+static void
+fluid_synth_update_cpu_voice_limit(fluid_synth_t* synth, double time,
+                                   int blockcount)
+{
+  int budget = fluid_atomic_int_get(&synth->cpu_budget);
+  int limit = fluid_atomic_int_get(&synth->cpu_voice_limit);
+  int active, new_limit;
+  float load;
+
+  if (budget <= 0 || blockcount <= 0) {
+    return;
+  }
+
+  /* render time in percent of the synthesized time, smoothed so that a
+   * single late block doesn't kill voices */
+  load = time * synth->sample_rate / (blockcount * synth->block_size) / 10000.0;
+  load = 0.5 * (synth->cpu_render_load + load);
+  synth->cpu_render_load = load;
+
+  if (load > budget) {
+    /* aim somewhat below the budget, not all voices cost the same */
+    active = fluid_rvoice_mixer_get_active_voices(synth->eventhandler->mixer);
+    new_limit = (int) (0.9f * active * budget / load);
+    if (new_limit < 1) {
+      new_limit = 1;
+    }
+    if (new_limit < limit) {
+      fluid_atomic_int_set(&synth->cpu_voice_limit, new_limit);
+      fluid_atomic_int_inc(&synth->cpu_overloads);
+    }
+  }
+  else if (load < 0.75f * budget && limit < synth->polyphony) {
+    new_limit = limit + 1 + limit / 64;
+    if (new_limit > synth->polyphony) {
+      new_limit = synth->polyphony;
+    }
+    fluid_atomic_int_set(&synth->cpu_voice_limit, new_limit);
+  }
+}
+
 
 /*
  * Handler for synth.overflow.* settings.
@@ -3446,39 +3995,72 @@ fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t* synth)
   float best_prio = OVERFLOW_PRIO_CANNOT_KILL-1;
   float this_voice_prio;
   fluid_voice_t* voice;
-  int best_voice_index=-1;
+  fluid_voice_t* best_voice = NULL;
   unsigned int ticks = fluid_synth_get_ticks(synth);
-  
-  for (i = 0; i < synth->polyphony; i++) {
 
-    voice = synth->voice[i];
+  /* Playing voices are kept in buckets of similar priority, oldest voice
+   * first. With a non-negative age score the priority within a bucket only
+   * grows with younger voices, apart from the volume term. So the scan of a
+   * bucket stops at the first voice whose priority can't get below the best
+   * one, whatever the attenuation in its bucket. A negative age score
+   * reverses the order, then all voices are scanned. */
+  for (i = 0; i < FLUID_STEAL_BUCKETS; i++) {
+    for (voice = synth->steal_head[i]; voice != NULL; voice = voice->steal_next) {
+
+      this_voice_prio = fluid_voice_get_overflow_prio(voice, &synth->overflow,
+                                                      ticks);
+      if (this_voice_prio >= OVERFLOW_PRIO_CANNOT_KILL) {
+        continue;
+      }
 
-    /* safeguard against an available voice. */
-    if (_AVAILABLE(voice)) {
-      return voice;
-    }
-    this_voice_prio = fluid_voice_get_overflow_prio(voice, &synth->overflow,
-						    ticks);
+      /* check if this voice has less priority than the previous candidate. */
+      if (this_voice_prio < best_prio) {
+        best_voice = voice;
+        best_prio = this_voice_prio;
+      }
 
-    /* check if this voice has less priority than the previous candidate. */
-    if (this_voice_prio < best_prio) {
-      best_voice_index = i;
-      best_prio = this_voice_prio;
+      if (synth->overflow.age >= 0
+          && fluid_voice_get_steal_prio_bound(voice, &synth->overflow,
+                                              this_voice_prio) >= best_prio) {
+        break;
+      }
     }
   }
 
-  if (best_voice_index < 0) {
+  if (best_voice == NULL) {
     return NULL;
   }
 
-  voice = synth->voice[best_voice_index];
-  FLUID_LOG(FLUID_DBG, "Killing voice %d, index %d, chan %d, key %d ",
-	    fluid_voice_get_id(voice), best_voice_index, fluid_voice_get_channel(voice), fluid_voice_get_key(voice));
+  voice = best_voice;
+  FLUID_LOG(FLUID_DBG, "Killing voice %d, chan %d, key %d ",
+	    fluid_voice_get_id(voice), fluid_voice_get_channel(voice), fluid_voice_get_key(voice));
   fluid_voice_off(voice);
 
   return voice;
 }
 
+/*
+ * Kill the voices with the lowest overflow priority until no more than
+ * limit voices are playing, limit being what the voice governor allows or
+ * less.
+ */
+static void
+fluid_synth_enforce_cpu_voice_limit_LOCAL(fluid_synth_t* synth, int limit)
+{
+  fluid_voice_t* voice;
+
+  while (synth->steal_count > limit) {
+    voice = fluid_synth_free_voice_by_kill_LOCAL(synth);
+    if (voice == NULL) {
+      break;
+    }
+    /* the voice stops once its rvoice has finished, until then it must
+     * not be chosen again */
+    fluid_voice_steal_remove(voice);
+    synth->cpu_kills++;
+  }
+}
+
 
 /**
  * Allocate a synthesis voice.
@@ -3509,17 +4091,19 @@ fluid_synth_alloc_voice(fluid_synth_t* synth, fluid_sample_t* sample,
 fluid_voice_t*
 fluid_synth_alloc_voice_LOCAL(fluid_synth_t* synth, fluid_sample_t* sample, int chan, int key, int vel, fluid_zone_range_t* zone_range)
 {
-  int i, k;
-  fluid_voice_t* voice = NULL;
+  fluid_voice_t* voice;
   fluid_channel_t* channel = NULL;
   unsigned int ticks;
 
-  /* check if there's an available synthesis process */
-  for (i = 0; i < synth->polyphony; i++) {
-    if (_AVAILABLE(synth->voice[i])) {
-      voice = synth->voice[i];
-      break;
-    }
+  /* check if there's an available synthesis process. It stays in the free
+   * list until it is started, so that a voice which is allocated but never
+   * started is handed out again. */
+  voice = synth->free_voice;
+
+  /* None left? Then allocate some more, if the polyphony allows. */
+  if (voice == NULL && synth->nvoice < synth->polyphony
+      && fluid_synth_add_voice_chunk_LOCAL(synth) == FLUID_OK) {
+    voice = synth->free_voice;
   }
 
   /* No success yet? Then stop a running voice. */
@@ -3527,6 +4111,12 @@ fluid_synth_alloc_voice_LOCAL(fluid_synth_t* synth, fluid_sample_t* sample, int
     FLUID_LOG(FLUID_DBG, "Polyphony exceeded, trying to kill a voice");
     voice = fluid_synth_free_voice_by_kill_LOCAL(synth);
   }
+  /* The voice governor doesn't allow another voice? Then replace a running
+   * voice of lower priority. */
+  else if (synth->steal_count >= fluid_atomic_int_get(&synth->cpu_voice_limit)) {
+    fluid_synth_enforce_cpu_voice_limit_LOCAL(synth,
+        fluid_atomic_int_get(&synth->cpu_voice_limit) - 1);
+  }
 
   if (voice == NULL) {
     FLUID_LOG(FLUID_WARN, "Failed to allocate a synthesis process. (chan=%d,key=%d)", chan, key);
@@ -3535,19 +4125,12 @@ fluid_synth_alloc_voice_LOCAL(fluid_synth_t* synth, fluid_sample_t* sample, int
   ticks = fluid_synth_get_ticks(synth);
 
   if (synth->verbose) {
-    k = 0;
-    for (i = 0; i < synth->polyphony; i++) {
-      if (!_AVAILABLE(synth->voice[i])) {
-	k++;
-      }
-    }
-
     FLUID_LOG(FLUID_INFO, "noteon\t%d\t%d\t%d\t%05d\t%.3f\t%.3f\t%.3f\t%d",
 	     chan, key, vel, synth->storeid,
 	     (float) ticks / 44100.0f,
 	     (fluid_curtime() - synth->start) / 1000.0f,
 	     0.0f,
-	     k);
+	     synth->active_voice_count);
   }
 
   channel = synth->channel[chan];
@@ -3558,6 +4141,10 @@ fluid_synth_alloc_voice_LOCAL(fluid_synth_t* synth, fluid_sample_t* sample, int
 	return NULL;
   }
 
+  /* voices of a fluid_synth_noteon_at() event start within the block */
+  if (synth->noteon_offset > 0)
+    fluid_voice_set_start_offset(voice, synth->noteon_offset);
+
   /* add the default modulators to the synthesis process. */
   /* custom_breath2att_modulator is not a default modulator specified in SF
     it is intended to replace default_vel2att_mod for this channel on demand using
@@ -3601,22 +4188,24 @@ fluid_synth_kill_by_exclusive_class_LOCAL(fluid_synth_t* synth,
                                           fluid_voice_t* new_voice)
 {
   int excl_class = fluid_voice_gen_value(new_voice, GEN_EXCLUSIVECLASS);
-  int i;
+  fluid_voice_t* existing_voice;
+  fluid_voice_t* next;
 
   /* Excl. class 0: No exclusive class */
   if (excl_class == 0) return;
 
-  /* Kill all notes on the same channel with the same exclusive class */
-  for (i = 0; i < synth->polyphony; i++) {
-    fluid_voice_t* existing_voice = synth->voice[i];
-    int existing_excl_class = fluid_voice_gen_value(existing_voice, GEN_EXCLUSIVECLASS);
+  /* Kill all notes on the same channel with the same exclusive class. The
+   * channel indexes its playing voices by exclusive class. */
+  for (existing_voice = new_voice->channel->excl_voices[excl_class & 0x7F];
+       existing_voice != NULL; existing_voice = next) {
+    /* killing the voice unlinks it */
+    next = existing_voice->excl_next;
 
-    /* If voice is playing, on the same channel, has same exclusive
-     * class and is not part of the same noteon event (voice group), then kill it */
+    /* If voice is playing, has same exclusive class and is not part of
+     * the same noteon event (voice group), then kill it */
 
     if (fluid_voice_is_playing(existing_voice)
-        && fluid_voice_get_channel(existing_voice) == fluid_voice_get_channel(new_voice)
-        && existing_excl_class == excl_class
+        && existing_voice->excl_class == excl_class
         && fluid_voice_get_id (existing_voice) != fluid_voice_get_id(new_voice))
       fluid_voice_kill_excl(existing_voice);
   }
@@ -3696,43 +4285,203 @@ fluid_synth_sfload(fluid_synth_t* synth, const char* filename, int reset_presets
 {
   fluid_sfont_info_t *sfont_info;
   fluid_sfont_t *sfont;
-  fluid_list_t *list;
-  fluid_sfloader_t *loader;
   unsigned int sfont_id;
 
   fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
   fluid_return_val_if_fail (filename != NULL, FLUID_FAILED);
   fluid_synth_api_enter(synth);
-  
-  /* MT NOTE: Loaders list should not change. */
+
+  sfont = fluid_synth_load_sfont(synth, filename);
+  if (sfont == NULL)
+    FLUID_API_RETURN(FLUID_FAILED);
+
+  sfont_info = new_fluid_sfont_info (synth, sfont);
+
+  if (!sfont_info)
+  {
+    fluid_sfont_delete_internal (sfont);
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  sfont->id = sfont_id = ++synth->sfont_id;
+  synth->sfont_info = fluid_list_prepend(synth->sfont_info, sfont_info);   /* prepend to list */
+  fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+  fluid_synth_invalidate_preset_cache (synth);
+
+  /* reset the presets for all channels if requested */
+  if (reset_presets) fluid_synth_program_reset(synth);
+
+  FLUID_API_RETURN((int)sfont_id);
+}
+
+/* Load a SoundFont file with the first loader that accepts it. This
+ * doesn't touch the synth state, the SoundFont loaders list doesn't
+ * change once SoundFonts are loaded. */
+static fluid_sfont_t*
+fluid_synth_load_sfont(fluid_synth_t* synth, const char* filename)
+{
+  fluid_sfont_t *sfont;
+  fluid_list_t *list;
+  fluid_sfloader_t *loader;
 
   for (list = synth->loaders; list; list = fluid_list_next(list)) {
     loader = (fluid_sfloader_t*) fluid_list_get(list);
 
     sfont = fluid_sfloader_load(loader, filename);
 
-    if (sfont != NULL) {
-      sfont_info = new_fluid_sfont_info (synth, sfont);
+    if (sfont != NULL)
+      return sfont;
+  }
 
-      if (!sfont_info)
-      {
-        fluid_sfont_delete_internal (sfont);
-        FLUID_API_RETURN(FLUID_FAILED);
-      }
+  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
+  return NULL;
+}
+
+/* A SoundFont being loaded in the background, see fluid_synth_sfload_async() */
+typedef struct
+{
+  fluid_synth_t* synth;
+  char* filename;
+  int reset_presets;
+  fluid_sfload_callback_t callback;
+  void* data;
+  fluid_thread_t* thread;
+  fluid_atomic_int_t done;              /**< Set once the thread is about to return */
+} fluid_sfload_request_t;
+
+static fluid_thread_return_t
+fluid_synth_sfload_async_run(void* data)
+{
+  fluid_sfload_request_t* request = (fluid_sfload_request_t*) data;
+  fluid_synth_t* synth = request->synth;
+  fluid_sfont_info_t *sfont_info = NULL;
+  fluid_sfont_t *sfont;
+  int sfont_id = FLUID_FAILED;
 
-      sfont->id = sfont_id = ++synth->sfont_id;
-      synth->sfont_info = fluid_list_prepend(synth->sfont_info, sfont_info);   /* prepend to list */
-      fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+  /* All of the parsing and I/O happens without holding the API lock */
+  sfont = fluid_synth_load_sfont(synth, request->filename);
+
+  if (sfont != NULL) {
+    fluid_synth_api_enter(synth);
 
-      /* reset the presets for all channels if requested */
-      if (reset_presets) fluid_synth_program_reset(synth);
+    sfont_info = new_fluid_sfont_info (synth, sfont);
+    if (sfont_info != NULL) {
+      sfont->id = ++synth->sfont_id;
+      sfont_id = (int)sfont->id;
+      synth->sfont_info = fluid_list_prepend(synth->sfont_info, sfont_info);
+      fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);
+      fluid_synth_invalidate_preset_cache (synth);
 
-      FLUID_API_RETURN((int)sfont_id);
+      if (request->reset_presets) fluid_synth_program_reset(synth);
     }
+
+    fluid_synth_api_exit(synth);
+
+    if (sfont_info == NULL)
+      fluid_sfont_delete_internal (sfont);
   }
 
-  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
-  FLUID_API_RETURN(FLUID_FAILED);
+  if (request->callback != NULL)
+    request->callback(request->data, request->filename, sfont_id);
+
+  fluid_atomic_int_set(&request->done, TRUE);
+  return FLUID_THREAD_RETURN_VALUE;
+}
+
+/* Join the threads of the background loads that are done, or of all of them
+ * if wait is TRUE */
+static void
+fluid_synth_cleanup_sfload_requests(fluid_synth_t* synth, int wait)
+{
+  fluid_sfload_request_t* request;
+  fluid_list_t *list, *next;
+
+  for (list = synth->sfload_requests; list; list = next) {
+    next = fluid_list_next(list);
+    request = (fluid_sfload_request_t*) fluid_list_get(list);
+
+    if (wait || fluid_atomic_int_get(&request->done)) {
+      fluid_thread_join(request->thread);
+      delete_fluid_thread(request->thread);
+      synth->sfload_requests = fluid_list_remove(synth->sfload_requests, request);
+      FLUID_FREE(request->filename);
+      FLUID_FREE(request);
+    }
+  }
+}
+
+/**
+ * Load a SoundFont file in the background. The file is parsed and loaded by
+ * a thread of its own without holding the synth lock, so that audio keeps
+ * being rendered and the synth keeps handling events with the SoundFonts
+ * loaded so far. Only putting the loaded SoundFont on top of the SoundFont
+ * stack (and re-assigning the presets of the MIDI channels if requested)
+ * locks the synth, as briefly as adding a SoundFont with
+ * fluid_synth_add_sfont().
+ *
+ * @param synth FluidSynth instance
+ * @param filename File to load
+ * @param reset_presets TRUE to re-assign presets for all MIDI channels once the SoundFont is loaded
+ * @param callback Function called from the loading thread once the SoundFont
+ *   has been loaded (or failed to load), may be NULL
+ * @param data User data passed to the callback
+ * @return #FLUID_OK if loading was started, #FLUID_FAILED otherwise
+ *
+ * The callback receives the ID of the loaded SoundFont, or #FLUID_FAILED. It
+ * runs without holding the synth lock, so it may call the synth API, for
+ * instance fluid_synth_sfunload() to drop the SoundFont that the new one
+ * replaces: with \c reset_presets the MIDI channels have already switched to
+ * the new SoundFont at that point.
+ *
+ * @note The SoundFont loaders of the synth must be safe to use from another
+ *   thread, which the default loader is. Requires the "synth.threadsafe-api"
+ *   setting. delete_fluid_synth() waits for pending loads to finish.
+ * @since 2.0.0
+ */
+int
+fluid_synth_sfload_async(fluid_synth_t* synth, const char* filename, int reset_presets,
+                         fluid_sfload_callback_t callback, void* data)
+{
+  fluid_sfload_request_t* request;
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_return_val_if_fail (filename != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  if (!synth->use_mutex) {
+    FLUID_LOG(FLUID_ERR, "Loading SoundFonts in the background requires synth.threadsafe-api");
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  fluid_synth_cleanup_sfload_requests(synth, FALSE);
+
+  request = FLUID_NEW(fluid_sfload_request_t);
+  if (request == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  FLUID_MEMSET(request, 0, sizeof(*request));
+  request->synth = synth;
+  request->reset_presets = reset_presets;
+  request->callback = callback;
+  request->data = data;
+  request->filename = FLUID_STRDUP(filename);
+  if (request->filename == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    FLUID_FREE(request);
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  request->thread = new_fluid_thread("sfload", fluid_synth_sfload_async_run, request, 0, FALSE);
+  if (request->thread == NULL) {
+    FLUID_FREE(request->filename);
+    FLUID_FREE(request);
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  synth->sfload_requests = fluid_list_prepend(synth->sfload_requests, request);
+  FLUID_API_RETURN(FLUID_OK);
 }
 
 /* Create a new SoundFont info structure, free with FLUID_FREE */
@@ -3780,6 +4529,7 @@ fluid_synth_sfunload(fluid_synth_t* synth, unsigned int id, int reset_presets)
     if (fluid_sfont_get_id (sfont_info->sfont) == id)
     {
       synth->sfont_info = fluid_list_remove (synth->sfont_info, sfont_info);
+      fluid_synth_invalidate_preset_cache (synth);
       break;
     }
   }
@@ -3858,7 +4608,6 @@ fluid_synth_sfreload(fluid_synth_t* synth, unsigned int id)
   char filename[1024];
   fluid_sfont_info_t *sfont_info, *old_sfont_info;
   fluid_sfont_t* sfont;
-  fluid_sfloader_t* loader;
   fluid_list_t *list;
   int index;
 
@@ -3882,35 +4631,27 @@ fluid_synth_sfreload(fluid_synth_t* synth, unsigned int id)
   if (fluid_synth_sfunload (synth, id, FALSE) != FLUID_OK)
     FLUID_API_RETURN(FLUID_FAILED);
 
-  /* MT Note: SoundFont loader list will not change */
-
-  for (list = synth->loaders; list; list = fluid_list_next(list)) {
-    loader = (fluid_sfloader_t*) fluid_list_get(list);
-
-    sfont = fluid_sfloader_load(loader, filename);
-
-    if (sfont != NULL) {
-      sfont->id = id;
+  sfont = fluid_synth_load_sfont(synth, filename);
+  if (sfont == NULL)
+    FLUID_API_RETURN(FLUID_FAILED);
 
-      sfont_info = new_fluid_sfont_info (synth, sfont);
+  sfont->id = id;
 
-      if (!sfont_info)
-      {
-        fluid_sfont_delete_internal (sfont);
-        FLUID_API_RETURN(FLUID_FAILED);
-      }
-
-      synth->sfont_info = fluid_list_insert_at(synth->sfont_info, index, sfont_info);  /* insert the sfont at the same index */
-      fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+  sfont_info = new_fluid_sfont_info (synth, sfont);
 
-      /* reset the presets for all channels */
-      fluid_synth_update_presets(synth);
-      FLUID_API_RETURN(sfont->id);
-    }
+  if (!sfont_info)
+  {
+    fluid_sfont_delete_internal (sfont);
+    FLUID_API_RETURN(FLUID_FAILED);
   }
 
-  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
-  FLUID_API_RETURN(FLUID_FAILED);  
+  synth->sfont_info = fluid_list_insert_at(synth->sfont_info, index, sfont_info);  /* insert the sfont at the same index */
+  fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+  fluid_synth_invalidate_preset_cache (synth);
+
+  /* reset the presets for all channels */
+  fluid_synth_update_presets(synth);
+  FLUID_API_RETURN(sfont->id);
 }
 
 /**
@@ -3936,6 +4677,7 @@ fluid_synth_add_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont)
   sfont->id = sfont_id = ++synth->sfont_id;
   synth->sfont_info = fluid_list_prepend (synth->sfont_info, sfont_info);       /* prepend to list */
   fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);   /* Hash sfont->sfont_info */
+  fluid_synth_invalidate_preset_cache (synth);
 
   /* reset the presets for all channels */
   fluid_synth_program_reset (synth);
@@ -3974,6 +4716,7 @@ fluid_synth_remove_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont)
 
       /* Remove from SoundFont hash regardless of refcount (SoundFont delete is up to caller) */
       fluid_hashtable_remove (synth->sfont_hash, sfont_info->sfont);
+      fluid_synth_invalidate_preset_cache (synth);
       break;
     }
   }
@@ -4121,7 +4864,7 @@ fluid_synth_get_voicelist(fluid_synth_t* synth, fluid_voice_t* buf[], int bufsiz
   fluid_return_if_fail (buf != NULL);
   fluid_synth_api_enter(synth);
 
-  for (i = 0; i < synth->polyphony && count < bufsize; i++) {
+  for (i = 0; i < synth->nvoice && count < bufsize; i++) {
     fluid_voice_t* voice = synth->voice[i];
 
     if (fluid_voice_is_playing(voice) && (id < 0 || (int)voice->id == id))
@@ -4561,7 +5304,6 @@ void
 fluid_synth_release_voice_on_same_note_LOCAL(fluid_synth_t* synth, int chan,
                                              int key)
 {
-  int i;
   fluid_voice_t* voice;
 
   /* storeid is a parameter for fluid_voice_init() */
@@ -4571,11 +5313,9 @@ fluid_synth_release_voice_on_same_note_LOCAL(fluid_synth_t* synth, int chan,
     if it exists (0 to 127) or INVALID_NOTE otherwise */
   if(key == INVALID_NOTE) return;
   
-  for (i = 0; i < synth->polyphony; i++) {
-    voice = synth->voice[i];
+  for (voice = synth->channel[chan]->key_voices[key]; voice != NULL;
+       voice = voice->key_next) {
     if (fluid_voice_is_playing(voice)
-	&& (fluid_voice_get_channel(voice) == chan)
-	&& (fluid_voice_get_key(voice) == key)
 	&& (fluid_voice_get_id(voice) != synth->noteid)) {
       /* Id of voices that was sustained by sostenuto */
       if(fluid_voice_is_sostenuto(voice))
@@ -4682,6 +5422,33 @@ fluid_synth_count_effects_channels(fluid_synth_t* synth)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Get the number of voices allocated so far and the memory they occupy.
+ *
+ * Voices are allocated in chunks as they are needed, up to the polyphony,
+ * and kept until the synth is deleted. So this is also the peak voice
+ * memory of the synth.
+ * @param synth FluidSynth instance
+ * @param voices Location to store the number of allocated voices or NULL
+ * @param bytes Location to store their memory in bytes or NULL
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ * @since 2.0.0
+ */
+int
+fluid_synth_get_voice_memory(fluid_synth_t* synth, int* voices, int* bytes)
+{
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  if (voices) {
+    *voices = synth->nvoice;
+  }
+  if (bytes) {
+    *bytes = synth->voice_memory;
+  }
+  FLUID_API_RETURN(FLUID_OK);
+}
+
 /**
  * Get the synth CPU load value.
  * @param synth FluidSynth instance
@@ -4694,6 +5461,72 @@ fluid_synth_get_cpu_load(fluid_synth_t* synth)
   return fluid_atomic_float_get (&synth->cpu_load);
 }
 
+/**
+ * Get the decisions of the voice governor.
+ *
+ * If the "synth.cpu-budget" setting is enabled, the number of voices is
+ * lowered whenever rendering takes more CPU time than the budget allows.
+ * @param synth FluidSynth instance
+ * @param voice_limit Location to store the number of voices currently allowed
+ *   (the polyphony if the governor doesn't limit the voices) or NULL
+ * @param overloads Location to store the number of renders that exceeded the
+ *   budget and lowered the limit, or NULL
+ * @param kills Location to store the number of voices killed to stay within
+ *   the limit, or NULL
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ * @since 2.0.0
+ */
+int
+fluid_synth_get_cpu_governor_stats(fluid_synth_t* synth, int* voice_limit,
+                                   int* overloads, int* kills)
+{
+  int limit;
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  if (voice_limit) {
+    limit = fluid_atomic_int_get(&synth->cpu_voice_limit);
+    *voice_limit = (limit < synth->polyphony) ? limit : synth->polyphony;
+  }
+  if (overloads) {
+    *overloads = fluid_atomic_int_get(&synth->cpu_overloads);
+  }
+  if (kills) {
+    *kills = synth->cpu_kills;
+  }
+  FLUID_API_RETURN(FLUID_OK);
+}
+
+/**
+ * Get the number of controller updates the synth coalesced.
+ *
+ * If the "synth.coalesce-controllers" setting is enabled, controller
+ * changes (MIDI CCs, pitch bend, channel and key pressure...) are applied to
+ * the voices once per block. Updates of a controller that arrive before the
+ * next block collapse into one.
+ * @param synth FluidSynth instance
+ * @param updates Location to store the number of controller updates that
+ *   were deferred, or NULL
+ * @param collapsed Location to store the number of those that collapsed
+ *   into an update that was already pending, or NULL
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ * @since 2.0.0
+ */
+int
+fluid_synth_get_coalescing_stats(fluid_synth_t* synth, int* updates, int* collapsed)
+{
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  if (updates) {
+    *updates = synth->coalesce_updates;
+  }
+  if (collapsed) {
+    *collapsed = synth->coalesce_collapsed;
+  }
+  FLUID_API_RETURN(FLUID_OK);
+}
+
 /* Get tuning for a given bank:program */
 static fluid_tuning_t *
 fluid_synth_get_tuning(fluid_synth_t* synth, int bank, int prog)
@@ -4783,13 +5616,10 @@ static void
 fluid_synth_update_voice_tuning_LOCAL (fluid_synth_t *synth, fluid_channel_t *channel)
 {
   fluid_voice_t *voice;
-  int i;
 
-  for (i = 0; i < synth->polyphony; i++)
+  for (voice = channel->voices; voice != NULL; voice = voice->chan_next)
   {
-    voice = synth->voice[i];
-
-    if (fluid_voice_is_on(voice) && (voice->channel == channel))
+    if (fluid_voice_is_on(voice))
     {
       fluid_voice_calculate_gen_pitch (voice);
       fluid_voice_update_param (voice, GEN_PITCH);
@@ -5188,16 +6018,11 @@ fluid_synth_set_gen_LOCAL (fluid_synth_t* synth, int chan, int param, float valu
                            int absolute)
 {
   fluid_voice_t* voice;
-  int i;
 
   fluid_channel_set_gen (synth->channel[chan], param, value, absolute);
 
-  for (i = 0; i < synth->polyphony; i++) {
-    voice = synth->voice[i];
-
-    if (fluid_voice_get_channel(voice) == chan)
-      fluid_voice_set_param (voice, param, value, absolute);
-  }
+  for (voice = synth->channel[chan]->voices; voice != NULL; voice = voice->chan_next)
+    fluid_voice_set_param (voice, param, value, absolute);
 }
 
 /**
@@ -5233,6 +6058,10 @@ fluid_synth_handle_midi_event(void* data, fluid_midi_event_t* event)
 
   switch(type) {
       case NOTE_ON:
+        if (event->frame_offset > 0)
+          return fluid_synth_noteon_at(synth, event->frame_offset, chan,
+                                       fluid_midi_event_get_key(event),
+                                       fluid_midi_event_get_velocity(event));
 	return fluid_synth_noteon(synth, chan,
                                   fluid_midi_event_get_key(event),
                                   fluid_midi_event_get_velocity(event));
@@ -5328,7 +6157,7 @@ fluid_synth_stop_LOCAL (fluid_synth_t *synth, unsigned int id)
   fluid_voice_t* voice;
   int i;
 
-  for (i = 0; i < synth->polyphony; i++) {
+  for (i = 0; i < synth->nvoice; i++) {
     voice = synth->voice[i];
 
     if (fluid_voice_is_on(voice) && (fluid_voice_get_id (voice) == id))
@@ -5359,6 +6188,7 @@ fluid_synth_set_bank_offset(fluid_synth_t* synth, int sfont_id, int offset)
     if (fluid_sfont_get_id (sfont_info->sfont) == (unsigned int)sfont_id)
     {
       sfont_info->bankofs = offset;
+      fluid_synth_invalidate_preset_cache (synth);
       break;
     }
   }
@@ -5413,10 +6243,34 @@ fluid_synth_api_enter(fluid_synth_t* synth)
   if (synth->use_mutex) {
     fluid_rec_mutex_lock(synth->mutex);
   }
+  if (!synth->public_api_count) {
+    fluid_synth_check_finished_voices(synth);
+    if (synth->steal_count > fluid_atomic_int_get(&synth->cpu_voice_limit)) {
+      fluid_synth_enforce_cpu_voice_limit_LOCAL(synth,
+          fluid_atomic_int_get(&synth->cpu_voice_limit));
+    }
+  }
+  synth->public_api_count++;
+}
+
+/*
+ * Like fluid_synth_api_enter(), but doesn't wait if another thread is in
+ * the public API. Used by the rendering thread, which must not block on a
+ * long-running API call.
+ * @return TRUE if the API was entered, then fluid_synth_api_exit() must
+ *   follow, FALSE otherwise
+ */
+static int
+fluid_synth_api_try_enter(fluid_synth_t* synth)
+{
+  if (synth->use_mutex && !fluid_rec_mutex_trylock(synth->mutex)) {
+    return FALSE;
+  }
   if (!synth->public_api_count) {
     fluid_synth_check_finished_voices(synth);
   }
   synth->public_api_count++;
+  return TRUE;
 }
 
 void fluid_synth_api_exit(fluid_synth_t* synth)
@@ -5446,6 +6300,7 @@ int fluid_synth_set_channel_type(fluid_synth_t* synth, int chan, int type)
   FLUID_API_ENTRY_CHAN(FLUID_FAILED);
   
   synth->channel[chan]->channel_type = type;
+  fluid_synth_update_steal_buckets_LOCAL(synth);
 
   FLUID_API_RETURN(FLUID_OK);
 }
@@ -5488,7 +6343,7 @@ int fluid_synth_set_custom_filter(fluid_synth_t* synth, int type, int flags)
     synth->custom_filter_type = type;
     synth->custom_filter_flags = flags;
     
-    for (i = 0; i < synth->polyphony; i++)
+    for (i = 0; i < synth->nvoice; i++)
     {
         voice = synth->voice[i];
         
@@ -5569,6 +6424,7 @@ static void fluid_synth_handle_important_channels(void *data, const char *name,
 
     fluid_synth_api_enter(synth);
     fluid_synth_set_important_channels(synth, value);
+    fluid_synth_update_steal_buckets_LOCAL(synth);
     fluid_synth_api_exit(synth);
 }
 
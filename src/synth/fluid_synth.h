@@ -94,7 +94,11 @@ typedef struct _fluid_sfont_info_t {
  *
  * ticks_since_start - atomic, set by rendering thread only
  * cpu_load - atomic, set by rendering thread only
+ * cpu_voice_limit, cpu_overloads - atomic, set by rendering thread only (cpu_voice_limit is reset by the API thread)
+ * cpu_render_load - used by rendering thread only
+ * coalesce_pending - atomic, set by API thread, cleared by rendering thread
  * cur, curmax, dither_index - used by rendering thread only
+ * process_left, process_right, process_fx_left, process_fx_right - used by rendering thread only
  * ladspa_fx - same instance copied in rendering thread. Synchronising handled internally.
  *
  */
@@ -110,8 +114,16 @@ struct _fluid_synth_t
   int polyphony;                     /**< Maximum polyphony */
   int with_reverb;                   /**< Should the synth use the built-in reverb unit? */
   int with_chorus;                   /**< Should the synth use the built-in chorus unit? */
+  int with_dynamic_quality;          /**< Should quiet voices be synthesized more cheaply? */
+  double quality_linear;             /**< Level in dB below which voices interpolate linearly */
+  double quality_none;               /**< Level in dB below which voices don't interpolate */
+  int coalesce_controllers;          /**< Should controller updates of the voices be applied once per block? */
+  fluid_atomic_int_t coalesce_pending; /**< Set when a channel has deferred controller updates */
+  int coalesce_updates;              /**< Number of deferred controller updates */
+  int coalesce_collapsed;            /**< Number of deferred controller updates merged with a pending one */
   int verbose;                       /**< Turn verbose mode on? */
   double sample_rate;                /**< The sample rate */
+  int block_size;                    /**< Number of audio frames synthesized at a time */
   int midi_channels;                 /**< the number of MIDI channels (>= 16) */
   int bank_select;                   /**< the style of Bank Select MIDI messages */
   int audio_channels;                /**< the number of audio channels (1 channel=left+right) */
@@ -127,14 +139,23 @@ struct _fluid_synth_t
   fluid_list_t *sfont_info;          /**< List of fluid_sfont_info_t for each loaded SoundFont (remains until SoundFont is unloaded) */
   fluid_hashtable_t *sfont_hash;     /**< Hash of fluid_sfont_t->fluid_sfont_info_t (remains until SoundFont is deleted) */
   unsigned int sfont_id;             /**< Incrementing ID assigned to each loaded SoundFont */
+  fluid_hashtable_t *preset_cache;   /**< Hash of bank and program number->fluid_sfont_info_t of the SoundFont providing the preset */
+  fluid_list_t *sfload_requests;     /**< SoundFonts being loaded in the background, see fluid_synth_sfload_async() */
 
   float gain;                        /**< master gain */
   fluid_channel_t** channel;         /**< the channels */
-  int nvoice;                        /**< the length of the synthesis process array (max polyphony allowed) */
+  int nvoice;                        /**< the length of the synthesis process array (allocated on demand, up to the largest polyphony so far) */
   fluid_voice_t** voice;             /**< the synthesis voices */
+  fluid_list_t* voice_chunks;        /**< memory chunks the synthesis voices live in */
+  int voice_memory;                  /**< bytes allocated for synthesis voices */
   int active_voice_count;            /**< count of active voices */
+  fluid_voice_t* free_voice;         /**< list of available voices below polyphony */
+  fluid_voice_t* steal_head[FLUID_STEAL_BUCKETS]; /**< playing voices by overflow bucket, oldest first */
+  fluid_voice_t* steal_tail[FLUID_STEAL_BUCKETS]; /**< youngest voice of each overflow bucket */
+  int steal_count;                   /**< number of voices in the overflow buckets */
   unsigned int noteid;               /**< the id is incremented for every new note. it's used for noteoff's  */
   unsigned int storeid;
+  int noteon_offset;                 /**< frame offset of the note-on being processed, see fluid_synth_noteon_at() */
   int fromkey_portamento;			 /**< fromkey portamento */
   fluid_rvoice_eventhandler_t* eventhandler;
 
@@ -153,7 +174,17 @@ struct _fluid_synth_t
   int curmax;                        /**< current amount of samples present in the audio buffers */
   int dither_index;		     /**< current index in random dither value buffer: fluid_synth_(write_s16|dither_s16) */
 
+  float** process_left;              /**< Left output buffers mapped by fluid_synth_process() (audio_channels in length) */
+  float** process_right;             /**< Right output buffers mapped by fluid_synth_process() (audio_channels in length) */
+  float** process_fx_left;           /**< Left effect buffers mapped by fluid_synth_process() (effects_channels in length) */
+  float** process_fx_right;          /**< Right effect buffers mapped by fluid_synth_process() (effects_channels in length) */
+
   fluid_atomic_float_t cpu_load;                    /**< CPU load in percent (CPU time required / audio synthesized time * 100) */
+  fluid_atomic_int_t cpu_budget;     /**< CPU budget of the voice governor in percent, 0 if disabled */
+  fluid_atomic_int_t cpu_voice_limit; /**< Number of voices the governor currently allows */
+  fluid_atomic_int_t cpu_overloads;  /**< Number of renders that exceeded the CPU budget */
+  int cpu_kills;                     /**< Number of voices killed to honour cpu_voice_limit */
+  float cpu_render_load;             /**< Smoothed render time in percent of the synthesized time */
 
   fluid_tuning_t*** tuning;          /**< 128 banks of 128 programs for the tunings */
   fluid_private_t tuning_iter;       /**< Tuning iterators per each thread */
@@ -209,6 +240,8 @@ void delete_fluid_sample_timer(fluid_synth_t* synth, fluid_sample_timer_t* timer
 
 void fluid_synth_process_event_queue(fluid_synth_t* synth);
 
+int fluid_synth_get_aligned_frames(fluid_synth_t* synth, int len);
+
 int fluid_synth_set_gen2 (fluid_synth_t* synth, int chan,
                                          int param, float value,
                                          int absolute, int normalized);
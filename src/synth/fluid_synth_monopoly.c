@@ -522,7 +522,6 @@ int fluid_synth_noteoff_monopoly(fluid_synth_t* synth, int chan, int key,
 {
 	int status = FLUID_FAILED;
 	fluid_voice_t* voice;
-	int i;
 	fluid_channel_t* channel = synth->channel[chan];
 	/* Key_sustained is prepared to return no note sustained (INVALID_NOTE) */
 	if (Mono)
@@ -530,29 +529,17 @@ int fluid_synth_noteoff_monopoly(fluid_synth_t* synth, int chan, int key,
 		channel->key_mono_sustained = INVALID_NOTE; /* no mono note sustained */
 	}
 	/* noteoff for all voices with same chan and same key */
-	for (i = 0; i < synth->polyphony; i++)
+	for (voice = channel->key_voices[key]; voice != NULL; voice = voice->key_next)
 	{
-		voice = synth->voice[i];
-		if (fluid_voice_is_on(voice) &&
-		    fluid_voice_get_channel(voice) == chan &&
-		    fluid_voice_get_key(voice) == key)
+		if (fluid_voice_is_on(voice))
 		{
 			if (synth->verbose)
 			{
-				int used_voices = 0;
-				int k;
-				for (k = 0; k < synth->polyphony; k++) 
-				{
-					if (!_AVAILABLE(synth->voice[k])) 
-					{
-						used_voices++;
-					}
-				}
 				FLUID_LOG(FLUID_INFO, "noteoff\t%d\t%d\t%d\t%05d\t%.3f\t%d",
 				         fluid_voice_get_channel(voice), fluid_voice_get_key(voice), 0, 
 				         fluid_voice_get_id(voice),
 				         (fluid_curtime() - synth->start) / 1000.0f,
-				         used_voices);
+				         synth->active_voice_count);
 			} /* if verbose */
             
 			fluid_voice_noteoff(voice);
@@ -626,17 +613,17 @@ int fluid_synth_noteon_monopoly_legato(fluid_synth_t* synth, int chan,
 	fluid_channel_t* channel = synth->channel[chan];
 	unsigned char legatomode = channel->legatomode;
 	fluid_voice_t* voice;
-	int i ;
+	fluid_voice_t* next;
 	/* Gets possible 'fromkey portamento' and possible 'fromkey legato' note  */
 	fromkey = fluid_synth_get_fromkey_portamento_legato( channel, (unsigned char)fromkey);
 
-	if (fluid_channel_is_valid_note(fromkey)) for (i = 0; i < synth->polyphony; i++) 
+	if (fluid_channel_is_valid_note(fromkey))
+	for (voice = channel->key_voices[fromkey]; voice != NULL; voice = next)
 	{
-		/* searching fromkey voices: only those who don't have 'note off' */
-		voice = synth->voice[i];
-		if (fluid_voice_is_on(voice) &&
-                    fluid_voice_get_channel(voice) == chan &&
-                    fluid_voice_get_key(voice) == fromkey)
+		/* searching fromkey voices: only those who don't have 'note off'.
+		   Multi retrigger moves the voice to tokey, so get the next one first */
+		next = voice->key_next;
+		if (fluid_voice_is_on(voice))
 		{
 			fluid_zone_range_t * zone_range = voice->zone_range;
 			/* Ignores voice when there is no instrument zone (i.e no zone_range). Otherwise
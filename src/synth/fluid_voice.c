@@ -41,6 +41,9 @@
 static const int32_t INT24_MAX = (1 << (16+8-1));
 
 static int fluid_voice_calculate_runtime_synthesis_parameters(fluid_voice_t* voice);
+static void fluid_voice_update_mod_deps(fluid_voice_t* voice);
+static void fluid_voice_channel_link(fluid_voice_t* voice);
+static void fluid_voice_excl_link(fluid_voice_t* voice);
 static int calculate_hold_decay_buffers(fluid_voice_t* voice, int gen_base,
                                         int gen_key2base, int is_decay);
 static fluid_real_t
@@ -153,6 +156,8 @@ static void fluid_voice_swap_rvoice(fluid_voice_t* voice)
 static void fluid_voice_initialize_rvoice(fluid_voice_t* voice)
 {
   FLUID_MEMSET(voice->rvoice, 0, sizeof(fluid_rvoice_t));
+  voice->rvoice->voice = voice;
+  voice->rvoice->mixer_index = -1;
 
   /* The 'sustain' and 'finished' segments of the volume / modulation
    * envelope are constant. They are never affected by any modulator
@@ -173,25 +178,19 @@ static void fluid_voice_initialize_rvoice(fluid_voice_t* voice)
 }
 
 /*
- * new_fluid_voice
+ * fluid_voice_setup
+ *
+ * Set up a voice in memory provided by the caller. The synth allocates
+ * voices together with their rvoices in chunks, as they are needed, and
+ * frees them when it is deleted.
  */
-fluid_voice_t*
-new_fluid_voice(fluid_real_t output_rate)
+void
+fluid_voice_setup(fluid_voice_t* voice, fluid_rvoice_t* rvoice,
+                  fluid_rvoice_t* overflow_rvoice,
+                  fluid_real_t output_rate, int block_size)
 {
-  fluid_voice_t* voice;
-  voice = FLUID_NEW(fluid_voice_t);
-  if (voice == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    return NULL;
-  }
-  voice->rvoice = FLUID_NEW(fluid_rvoice_t);
-  voice->overflow_rvoice = FLUID_NEW(fluid_rvoice_t);
-  if (voice->rvoice == NULL || voice->overflow_rvoice == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    FLUID_FREE(voice->rvoice);
-    FLUID_FREE(voice);
-    return NULL;
-  }
+  voice->rvoice = rvoice;
+  voice->overflow_rvoice = overflow_rvoice;
 
   voice->status = FLUID_VOICE_CLEAN;
   voice->chan = NO_CHANNEL;
@@ -199,6 +198,20 @@ new_fluid_voice(fluid_real_t output_rate)
   voice->vel = 0;
   voice->channel = NULL;
   voice->sample = NULL;
+  voice->free_prev = NULL;
+  voice->free_next = NULL;
+  voice->is_free = FALSE;
+  voice->above_polyphony = FALSE;
+  voice->chan_prev = NULL;
+  voice->chan_next = NULL;
+  voice->key_prev = NULL;
+  voice->key_next = NULL;
+  voice->excl_prev = NULL;
+  voice->excl_next = NULL;
+  voice->excl_class = 0;
+  voice->steal_prev = NULL;
+  voice->steal_next = NULL;
+  voice->steal_bucket = -1;
 
   /* Initialize both the rvoice and overflow_rvoice */
   voice->can_access_rvoice = TRUE; 
@@ -207,25 +220,12 @@ new_fluid_voice(fluid_real_t output_rate)
   fluid_voice_swap_rvoice(voice);
   fluid_voice_initialize_rvoice(voice);
 
-  fluid_voice_set_output_rate(voice, output_rate);
-
-  return voice;
-}
+  /* The block size is fixed for the lifetime of the voice */
+  voice->block_size = block_size;
+  voice->rvoice->dsp.block_size = block_size;
+  voice->overflow_rvoice->dsp.block_size = block_size;
 
-/*
- * delete_fluid_voice
- */
-void
-delete_fluid_voice(fluid_voice_t* voice)
-{
-  fluid_return_if_fail(voice != NULL);
-  
-  if (!voice->can_access_rvoice || !voice->can_access_overflow_rvoice) {
-    FLUID_LOG(FLUID_WARN, "Deleting voice %u which has locked rvoices!", voice->id);
-  }
-  FLUID_FREE(voice->overflow_rvoice);
-  FLUID_FREE(voice->rvoice);
-  FLUID_FREE(voice);
+  fluid_voice_set_output_rate(voice, output_rate);
 }
 
 /* fluid_voice_init
@@ -258,16 +258,32 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
   }
   /* We are now guaranteed to have access to the rvoice */
 
-  if (voice->sample)
+  if (voice->sample) {
     fluid_voice_off(voice);
 
+    /* The voice is reused before fluid_voice_stop() was called, i.e. it has
+     * been stolen. Its old rvoice finishes as overflow rvoice and never
+     * reaches fluid_voice_stop(), so release the voice count and the sample
+     * reference here. */
+    if (fluid_voice_is_playing(voice))
+      voice->channel->synth->active_voice_count--;
+    fluid_voice_steal_remove(voice);
+    fluid_sample_null_ptr(&voice->sample);
+  }
+
+  fluid_voice_excl_unlink(voice);
+  fluid_voice_channel_unlink(voice);
+
   voice->zone_range = inst_zone_range; /* Instrument zone range for legato */
   voice->id = id;
   voice->chan = fluid_channel_get_num(channel);
   voice->key = (unsigned char) key;
   voice->vel = (unsigned char) vel;
   voice->channel = channel;
+  fluid_voice_channel_link(voice);
   voice->mod_count = 0;
+  voice->mod_dest_count = 0;
+  voice->mod_dep_count = 0;
   voice->start_time = start_time;
   voice->has_noteoff = 0;
   UPDATE_RVOICE0(fluid_rvoice_reset);
@@ -332,6 +348,19 @@ fluid_voice_set_output_rate(fluid_voice_t* voice, fluid_real_t value)
 }
 
 
+/**
+ * Delay the start of a voice which has not been started yet.
+ * @param voice Voice instance, as returned by fluid_voice_init()
+ * @param frames Number of frames the voice stays silent, counted from the
+ *   start of the next block being synthesized
+ */
+void
+fluid_voice_set_start_offset(fluid_voice_t* voice, int frames)
+{
+  UPDATE_RVOICE_I1(fluid_rvoice_set_start_offset, frames);
+}
+
+
 /**
  * Set the value of a generator.
  * @param voice Voice instance
@@ -345,6 +374,8 @@ fluid_voice_gen_set(fluid_voice_t* voice, int i, float val)
   voice->gen[i].flags = GEN_SET;
   if (i == GEN_SAMPLEMODE)
     UPDATE_RVOICE_I1(fluid_rvoice_set_samplemode, (int) val);
+  else if (i == GEN_EXCLUSIVECLASS && fluid_voice_is_playing(voice))
+    fluid_voice_excl_link(voice);
 }
 
 /**
@@ -358,6 +389,8 @@ fluid_voice_gen_incr(fluid_voice_t* voice, int i, float val)
 {
   voice->gen[i].val += val;
   voice->gen[i].flags = GEN_SET;
+  if (i == GEN_EXCLUSIVECLASS && fluid_voice_is_playing(voice))
+    fluid_voice_excl_link(voice);
 }
 
 /**
@@ -389,7 +422,7 @@ fluid_real_t fluid_voice_gen_value(const fluid_voice_t* voice, int num)
  * Synthesize a voice to a buffer.
  *
  * @param voice Voice to synthesize
- * @param dsp_buf Audio buffer to synthesize to (#FLUID_BUFSIZE in length)
+ * @param dsp_buf Audio buffer to synthesize to (voice->block_size in length)
  * @return Count of samples written to dsp_buf (can be 0)
  *
  * Panning, reverb and chorus are processed separately. The dsp interpolation
@@ -407,7 +440,7 @@ fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf)
   if (result == -1)
     return 0;
 
-  if ((result < FLUID_BUFSIZE) && fluid_voice_is_playing(voice)) /* Voice finished by itself */
+  if ((result < voice->block_size) && fluid_voice_is_playing(voice)) /* Voice finished by itself */
     fluid_voice_off(voice);
 
   return result;
@@ -432,6 +465,9 @@ void fluid_voice_start(fluid_voice_t* voice)
 
   /* Increment voice count */
   voice->channel->synth->active_voice_count++;
+  fluid_voice_free_list_remove(&voice->channel->synth->free_voice, voice);
+  fluid_voice_steal_insert(voice);
+  fluid_voice_excl_link(voice);
 }
 
 /**
@@ -498,7 +534,6 @@ fluid_voice_calculate_gen_pitch(fluid_voice_t* voice)
 static int
 fluid_voice_calculate_runtime_synthesis_parameters(fluid_voice_t* voice)
 {
-  int i;
   unsigned int n;
 
   static int const list_of_generators_to_initialize[] = {
@@ -576,8 +611,12 @@ fluid_voice_calculate_runtime_synthesis_parameters(fluid_voice_t* voice)
    * fluid_gen_set_default_values.
    */
 
-  for (i = 0; i < voice->mod_count; i++) {
-    fluid_mod_t* mod = &voice->mod[i];
+  fluid_voice_update_mod_deps(voice);
+
+  /* The modulators are processed grouped by generator (see
+   * fluid_voice_update_mod_deps()) */
+  for (n = 0; n < voice->mod_dest_start[voice->mod_dest_count]; n++) {
+    fluid_mod_t* mod = &voice->mod[voice->mod_order[n]];
     fluid_real_t modval = fluid_mod_get_value(mod, voice->channel, voice);
     int dest_gen_index = mod->dest;
     fluid_gen_t* dest_gen = &voice->gen[dest_gen_index];
@@ -673,11 +712,11 @@ calculate_hold_decay_buffers(fluid_voice_t* voice, int gen_base,
   }
 
   seconds = fluid_tc2sec(timecents);
-  /* Each DSP loop processes FLUID_BUFSIZE samples. */
+  /* Each DSP loop processes block_size samples. */
 
   /* round to next full number of buffers */
   buffers = (int)(((fluid_real_t)voice->output_rate * seconds)
-		  / (fluid_real_t)FLUID_BUFSIZE
+		  / (fluid_real_t)voice->block_size
 		  +0.5);
 
   return buffers;
@@ -739,6 +778,7 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
      * OHPiano.SF2 sets initial attenuation to a whooping -96 dB */
     fluid_clip(voice->attenuation, 0.0, 1440.0);
     UPDATE_RVOICE_R1(fluid_rvoice_set_attenuation, voice->attenuation);
+    fluid_voice_steal_update(voice);
     break;
 
     /* The pitch is calculated from three different generators.
@@ -839,22 +879,22 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
     break;
 
   case GEN_MODLFOFREQ:
-    /* - the frequency is converted into a delta value, per buffer of FLUID_BUFSIZE samples
+    /* - the frequency is converted into a delta value, per buffer of block_size samples
      * - the delay into a sample delay
      */
     fluid_clip(x, -16000.0f, 4500.0f);
-    x = (4.0f * FLUID_BUFSIZE * fluid_act2hz(x) / voice->output_rate);
+    x = (4.0f * voice->block_size * fluid_act2hz(x) / voice->output_rate);
     UPDATE_RVOICE_ENVLFO_R1(fluid_lfo_set_incr, modlfo, x);
     break;
 
   case GEN_VIBLFOFREQ:
     /* vib lfo
      *
-     * - the frequency is converted into a delta value, per buffer of FLUID_BUFSIZE samples
+     * - the frequency is converted into a delta value, per buffer of block_size samples
      * - the delay into a sample delay
      */
     fluid_clip(x, -16000.0f, 4500.0f);
-    x = 4.0f * FLUID_BUFSIZE * fluid_act2hz(x) / voice->output_rate;
+    x = 4.0f * voice->block_size * fluid_act2hz(x) / voice->output_rate;
     UPDATE_RVOICE_ENVLFO_R1(fluid_lfo_set_incr, viblfo, x); 
     break;
 
@@ -984,9 +1024,9 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
     break;
 
     /* Conversion functions differ in range limit */
-#define NUM_BUFFERS_DELAY(_v)   (unsigned int) (voice->output_rate * fluid_tc2sec_delay(_v) / FLUID_BUFSIZE)
-#define NUM_BUFFERS_ATTACK(_v)  (unsigned int) (voice->output_rate * fluid_tc2sec_attack(_v) / FLUID_BUFSIZE)
-#define NUM_BUFFERS_RELEASE(_v) (unsigned int) (voice->output_rate * fluid_tc2sec_release(_v) / FLUID_BUFSIZE)
+#define NUM_BUFFERS_DELAY(_v)   (unsigned int) (voice->output_rate * fluid_tc2sec_delay(_v) / voice->block_size)
+#define NUM_BUFFERS_ATTACK(_v)  (unsigned int) (voice->output_rate * fluid_tc2sec_attack(_v) / voice->block_size)
+#define NUM_BUFFERS_RELEASE(_v) (unsigned int) (voice->output_rate * fluid_tc2sec_release(_v) / voice->block_size)
 
     /* volume envelope
      *
@@ -1071,9 +1111,119 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
 
     break;
 
+  case GEN_EXCLUSIVECLASS:
+    /* Keep the exclusive class index in line with modulators and NRPNs */
+    if (fluid_voice_is_playing(voice))
+      fluid_voice_excl_link(voice);
+    break;
+
   } /* switch gen */
 }
 
+/* Key of a modulator source in fluid_voice_t::mod_dep */
+#define FLUID_MOD_SOURCE_KEY(_cc, _ctrl)  (((_cc) ? 0 : 128) + (_ctrl))
+
+/* Insert an entry into the sorted dependency table, unless it exists */
+static void
+fluid_voice_insert_mod_dep(fluid_voice_t* voice, unsigned short dep)
+{
+  int i, k;
+
+  for (i = 0; (i < voice->mod_dep_count) && (voice->mod_dep[i] < dep); i++);
+
+  if ((i < voice->mod_dep_count) && (voice->mod_dep[i] == dep)) {
+    return;
+  }
+  for (k = voice->mod_dep_count; k > i; k--) {
+    voice->mod_dep[k] = voice->mod_dep[k - 1];
+  }
+  voice->mod_dep[i] = dep;
+  voice->mod_dep_count++;
+}
+
+/*
+ * fluid_voice_update_mod_deps
+ *
+ * Build the dependency table of the modulators of a voice, once its
+ * modulator list is complete. The modulators are grouped by destination
+ * generator, in their original order so that the modulation values add up
+ * the same way. Each source (controller) refers to the generators it
+ * modulates.
+ */
+static void
+fluid_voice_update_mod_deps(fluid_voice_t* voice)
+{
+  unsigned char dest_index[GEN_LAST];
+  unsigned char count[FLUID_NUM_MOD];
+  fluid_mod_t* mod;
+  int i, k, dest, src, dep;
+
+  FLUID_MEMSET(dest_index, 0xff, sizeof(dest_index));
+  voice->mod_dest_count = 0;
+  voice->mod_dep_count = 0;
+
+  for (i = 0; i < voice->mod_count; i++) {
+    mod = &voice->mod[i];
+
+    /* the default vel-to-filter modulator doesn't contribute */
+    if (mod->vel2filter) {
+      continue;
+    }
+
+    if (dest_index[mod->dest] == 0xff) {
+      dest_index[mod->dest] = (unsigned char) voice->mod_dest_count;
+      voice->mod_dest[voice->mod_dest_count] = mod->dest;
+      count[voice->mod_dest_count++] = 0;
+    }
+    dest = dest_index[mod->dest];
+    count[dest]++;
+
+    /* insert both sources, keeping the table sorted and without
+     * duplicates. Controller numbers are seven-bit values. */
+    for (k = 0; k < 2; k++) {
+      src = (k == 0) ? mod->src1 : mod->src2;
+      if (src < 128) {
+        dep = FLUID_MOD_SOURCE_KEY((k == 0) ? (mod->flags1 & FLUID_MOD_CC)
+                                            : (mod->flags2 & FLUID_MOD_CC), src);
+        fluid_voice_insert_mod_dep(voice, (unsigned short) ((dep << 8) | dest));
+      }
+    }
+  }
+
+  voice->mod_dest_start[0] = 0;
+  for (i = 0; i < voice->mod_dest_count; i++) {
+    voice->mod_dest_start[i + 1] = (unsigned char) (voice->mod_dest_start[i] + count[i]);
+    count[i] = voice->mod_dest_start[i];
+  }
+  for (i = 0; i < voice->mod_count; i++) {
+    dest = dest_index[voice->mod[i].dest];
+    if ((dest != 0xff) && !voice->mod[i].vel2filter) {
+      voice->mod_order[count[dest]++] = (unsigned char) i;
+    }
+  }
+}
+
+/*
+ * fluid_voice_modulate_dest
+ *
+ * Sum up the modulators of a modulated generator and recalculate the
+ * parameters that depend on it.
+ */
+static void
+fluid_voice_modulate_dest(fluid_voice_t* voice, int dest)
+{
+  fluid_real_t modval = 0.0;
+  int gen = voice->mod_dest[dest];
+  int i;
+
+  for (i = voice->mod_dest_start[dest]; i < voice->mod_dest_start[dest + 1]; i++) {
+    modval += fluid_mod_get_value(&voice->mod[voice->mod_order[i]], voice->channel, voice);
+  }
+
+  fluid_gen_set_mod(&voice->gen[gen], modval);
+  fluid_voice_update_param(voice, gen);
+}
+
 /**
  * Recalculate voice parameters for a given control.
  * @param voice the synthesis voice
@@ -1088,9 +1238,9 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
  *
  * The update is done in three steps:
  *
- * - first, we look for all the modulators that have the changed
- * controller as a source. This will yield a list of generators that
- * will be changed because of the controller event.
+ * - first, we look up the generators that are modulated by the changed
+ * controller in the dependency table of the voice. Each of them is
+ * listed once.
  *
  * - For every changed generator, calculate its new value. This is the
  * sum of its original value plus the values of al the attached
@@ -1101,39 +1251,24 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
  */
 int fluid_voice_modulate(fluid_voice_t* voice, int cc, int ctrl)
 {
-  int i, k;
-  fluid_mod_t* mod;
-  int gen;
-  fluid_real_t modval;
+  int i, source;
 
 /*    printf("Chan=%d, CC=%d, Src=%d, Val=%d\n", voice->channel->channum, cc, ctrl, val); */
 
-  for (i = 0; i < voice->mod_count; i++) {
-
-    mod = &voice->mod[i];
-
-    /* step 1: find all the modulators that have the changed controller
-     * as input source. */
-    if (fluid_mod_has_source(mod, cc, ctrl)) {
+  if ((ctrl < 0) || (ctrl > 127)) {
+    return FLUID_OK;
+  }
+  source = FLUID_MOD_SOURCE_KEY(cc, ctrl);
 
-      gen = fluid_mod_get_dest(mod);
-      modval = 0.0;
+  /* step 1: find the generators modulated by the changed controller.
+   * The table is sorted by source. */
+  for (i = 0; (i < voice->mod_dep_count) && ((voice->mod_dep[i] >> 8) < source); i++);
 
-      /* step 2: for every changed modulator, calculate the modulation
-       * value of its associated generator */
-      for (k = 0; k < voice->mod_count; k++) {
-	if (fluid_mod_has_dest(&voice->mod[k], gen)) {
-	  modval += fluid_mod_get_value(&voice->mod[k], voice->channel, voice);
-	}
-      }
-
-      fluid_gen_set_mod(&voice->gen[gen], modval);
+  for (; (i < voice->mod_dep_count) && ((voice->mod_dep[i] >> 8) == source); i++) {
 
-      /* step 3: now that we have the new value of the generator,
-       * recalculate the parameter values that are derived from the
-       * generator */
-      fluid_voice_update_param(voice, gen);
-    }
+    /* steps 2 and 3: calculate the modulation value of the generator
+     * and the parameter values that are derived from it */
+    fluid_voice_modulate_dest(voice, voice->mod_dep[i] & 0xff);
   }
   return FLUID_OK;
 }
@@ -1145,38 +1280,12 @@ int fluid_voice_modulate(fluid_voice_t* voice, int cc, int ctrl)
  */
 int fluid_voice_modulate_all(fluid_voice_t* voice)
 {
-  fluid_mod_t* mod;
-  int i, k, gen;
-  fluid_real_t modval;
-
-  /* Loop through all the modulators.
-
-     FIXME: we should loop through the set of generators instead of
-     the set of modulators. We risk to call 'fluid_voice_update_param'
-     several times for the same generator if several modulators have
-     that generator as destination. It's not an error, just a wast of
-     energy (think polution, global warming, unhappy musicians,
-     ...) */
-
-  for (i = 0; i < voice->mod_count; i++) {
-
-    mod = &voice->mod[i];
-    gen = fluid_mod_get_dest(mod);
-    modval = 0.0;
-
-    /* Accumulate the modulation values of all the modulators with
-     * destination generator 'gen' */
-    for (k = 0; k < voice->mod_count; k++) {
-      if (fluid_mod_has_dest(&voice->mod[k], gen)) {
-	modval += fluid_mod_get_value(&voice->mod[k], voice->channel, voice);
-      }
-    }
-
-    fluid_gen_set_mod(&voice->gen[gen], modval);
+  int i;
 
-    /* Update the parameter values that are depend on the generator
-     * 'gen' */
-    fluid_voice_update_param(voice, gen);
+  /* Loop through the set of modulated generators, so that the parameters
+   * of each are updated once. */
+  for (i = 0; i < voice->mod_dest_count; i++) {
+    fluid_voice_modulate_dest(voice, i);
   }
 
   return FLUID_OK;
@@ -1207,7 +1316,7 @@ void fluid_voice_update_portamento (fluid_voice_t* voice, int fromkey,int tokey)
 	unsigned int countinc = (unsigned int)(((fluid_real_t)voice->output_rate * 
 					0.001f *
 			        (fluid_real_t)fluid_channel_portamentotime(channel))  /
-					(fluid_real_t)FLUID_BUFSIZE  +0.5);
+					(fluid_real_t)voice->block_size  +0.5);
 
 	/* Sends portamento parameters to the voice dsp */
 	UPDATE_RVOICE2(fluid_rvoice_set_portamento, countinc, pitchoffset); 
@@ -1226,7 +1335,9 @@ void fluid_voice_update_portamento (fluid_voice_t* voice, int fromkey,int tokey)
 void fluid_voice_update_multi_retrigger_attack(fluid_voice_t* voice,
                                                int tokey, int vel)
 {
+	fluid_voice_channel_unlink(voice);
 	voice->key = tokey;  /* new note */
+	fluid_voice_channel_link(voice);
 	voice->vel = vel; /* new velocity */
 	/* Updates generators dependent of velocity */
 	/* Modulates GEN_ATTENUATION (and others ) before calling
@@ -1261,6 +1372,7 @@ fluid_voice_release(fluid_voice_t* voice)
     unsigned int at_tick = fluid_channel_get_min_note_length_ticks (voice->channel);
     UPDATE_RVOICE_I1(fluid_rvoice_noteoff, at_tick);
     voice->has_noteoff = 1; // voice is marked as noteoff occured
+    fluid_voice_steal_update(voice);
 }
 
 /*
@@ -1291,6 +1403,8 @@ fluid_voice_noteoff(fluid_voice_t* voice)
   /* Or force the voice to release stage */
   else
     fluid_voice_release(voice);
+
+  fluid_voice_steal_update(voice);
 }
 
 /*
@@ -1367,6 +1481,8 @@ fluid_voice_stop(fluid_voice_t* voice)
 {
   fluid_profile(FLUID_PROF_VOICE_RELEASE, voice->ref, 0, 0);
 
+  fluid_voice_excl_unlink(voice);
+  fluid_voice_channel_unlink(voice);
   voice->chan = NO_CHANNEL;
   
   if (voice->can_access_rvoice)
@@ -1380,6 +1496,326 @@ fluid_voice_stop(fluid_voice_t* voice)
 
   /* Decrement voice count */
   voice->channel->synth->active_voice_count--;
+  if (!voice->above_polyphony)
+    fluid_voice_free_list_add(&voice->channel->synth->free_voice, voice);
+  fluid_voice_steal_remove(voice);
+}
+
+/*
+ * fluid_voice_free_list_add
+ *
+ * Push a voice onto a list of available voices. Does nothing if the voice
+ * already is in the list.
+ */
+void
+fluid_voice_free_list_add(fluid_voice_t** list, fluid_voice_t* voice)
+{
+  if (voice->is_free)
+    return;
+
+  voice->free_prev = NULL;
+  voice->free_next = *list;
+  if (*list != NULL)
+    (*list)->free_prev = voice;
+  *list = voice;
+  voice->is_free = TRUE;
+}
+
+/*
+ * fluid_voice_free_list_remove
+ *
+ * Unlink a voice from a list of available voices. Does nothing if the voice
+ * is not in the list.
+ */
+void
+fluid_voice_free_list_remove(fluid_voice_t** list, fluid_voice_t* voice)
+{
+  if (!voice->is_free)
+    return;
+
+  if (voice->free_prev != NULL)
+    voice->free_prev->free_next = voice->free_next;
+  else
+    *list = voice->free_next;
+  if (voice->free_next != NULL)
+    voice->free_next->free_prev = voice->free_prev;
+
+  voice->free_prev = NULL;
+  voice->free_next = NULL;
+  voice->is_free = FALSE;
+}
+
+/*
+ * fluid_voice_channel_link
+ *
+ * Add a voice to the voice index of its channel.
+ */
+static void
+fluid_voice_channel_link(fluid_voice_t* voice)
+{
+  fluid_channel_t* channel = voice->channel;
+  fluid_voice_t** key_list = &channel->key_voices[voice->key];
+
+  voice->chan_prev = NULL;
+  voice->chan_next = channel->voices;
+  if (channel->voices != NULL)
+    channel->voices->chan_prev = voice;
+  channel->voices = voice;
+
+  voice->key_prev = NULL;
+  voice->key_next = *key_list;
+  if (*key_list != NULL)
+    (*key_list)->key_prev = voice;
+  *key_list = voice;
+}
+
+/*
+ * fluid_voice_channel_unlink
+ *
+ * Remove a voice from the voice index of its channel. Voices are in the index
+ * from fluid_voice_init() until fluid_voice_stop(), i.e. as long as
+ * voice->chan is valid.
+ */
+void
+fluid_voice_channel_unlink(fluid_voice_t* voice)
+{
+  fluid_channel_t* channel = voice->channel;
+
+  if (voice->chan == NO_CHANNEL)
+    return;
+
+  if (voice->chan_prev != NULL)
+    voice->chan_prev->chan_next = voice->chan_next;
+  else
+    channel->voices = voice->chan_next;
+  if (voice->chan_next != NULL)
+    voice->chan_next->chan_prev = voice->chan_prev;
+
+  if (voice->key_prev != NULL)
+    voice->key_prev->key_next = voice->key_next;
+  else
+    channel->key_voices[voice->key] = voice->key_next;
+  if (voice->key_next != NULL)
+    voice->key_next->key_prev = voice->key_prev;
+
+  voice->chan_prev = NULL;
+  voice->chan_next = NULL;
+  voice->key_prev = NULL;
+  voice->key_next = NULL;
+}
+
+/*
+ * fluid_voice_excl_link
+ *
+ * Add a started voice to the exclusive class index of its channel, if it
+ * has an exclusive class.
+ */
+static void
+fluid_voice_excl_link(fluid_voice_t* voice)
+{
+  fluid_voice_t** list;
+  int excl_class = fluid_voice_gen_value(voice, GEN_EXCLUSIVECLASS);
+
+  fluid_voice_excl_unlink(voice);
+  if (excl_class == 0)
+    return;
+
+  list = &voice->channel->excl_voices[excl_class & 0x7F];
+  voice->excl_prev = NULL;
+  voice->excl_next = *list;
+  if (*list != NULL)
+    (*list)->excl_prev = voice;
+  *list = voice;
+  voice->excl_class = excl_class;
+}
+
+/*
+ * fluid_voice_excl_unlink
+ *
+ * Remove a voice from the exclusive class index of its channel.
+ */
+void
+fluid_voice_excl_unlink(fluid_voice_t* voice)
+{
+  if (voice->excl_class == 0)
+    return;
+
+  if (voice->excl_prev != NULL)
+    voice->excl_prev->excl_next = voice->excl_next;
+  else
+    voice->channel->excl_voices[voice->excl_class & 0x7F] = voice->excl_next;
+  if (voice->excl_next != NULL)
+    voice->excl_next->excl_prev = voice->excl_prev;
+
+  voice->excl_prev = NULL;
+  voice->excl_next = NULL;
+  voice->excl_class = 0;
+}
+
+/* attenuation (cB) limits of the overflow bucket volume bins, finer where
+ * score->volume / attenuation is large */
+static const fluid_real_t fluid_steal_att_limits[FLUID_STEAL_VOLUME_BINS - 1] = {
+  1.0f, 3.0f, 10.0f, 30.0f, 100.0f, 300.0f
+};
+
+/*
+ * fluid_voice_get_steal_bucket
+ *
+ * Get the overflow bucket of a voice. The grouping follows the terms of
+ * fluid_voice_get_overflow_prio(), apart from the age term.
+ */
+static int
+fluid_voice_get_steal_bucket(const fluid_voice_t* voice,
+                             const fluid_overflow_prio_t* score)
+{
+  int bucket, i;
+
+  if (voice->channel->channel_type == CHANNEL_TYPE_DRUM) {
+    bucket = 0;
+  } else if (voice->has_noteoff) {
+    bucket = 1;
+  } else if (fluid_voice_is_sustained(voice) || fluid_voice_is_sostenuto(voice)) {
+    bucket = 2;
+  } else {
+    bucket = 3;
+  }
+
+  bucket *= 2;
+  if (voice->chan < score->num_important_channels
+      && score->important_channels[voice->chan]) {
+    bucket++;
+  }
+
+  for (i = 0; i < FLUID_STEAL_VOLUME_BINS - 1; i++) {
+    if (voice->attenuation < fluid_steal_att_limits[i])
+      break;
+  }
+
+  return bucket * FLUID_STEAL_VOLUME_BINS + i;
+}
+
+/*
+ * fluid_voice_get_steal_prio_bound
+ *
+ * Get a lower bound of the overflow priority of the voices in the same
+ * bucket as voice that are not older than it. prio is the overflow priority
+ * of voice. The bound replaces the volume term of voice with the lowest one
+ * its volume bin allows. It only holds if score->age >= 0, because the age
+ * term grows with younger voices then.
+ */
+float
+fluid_voice_get_steal_prio_bound(const fluid_voice_t* voice,
+                                 const fluid_overflow_prio_t* score,
+                                 float prio)
+{
+  fluid_real_t a, low, high;
+  int bin;
+
+  if (!score->volume || voice->steal_bucket < 0) {
+    return prio;
+  }
+
+  bin = voice->steal_bucket % FLUID_STEAL_VOLUME_BINS;
+  low = (bin > 0) ? fluid_steal_att_limits[bin - 1] : 0.1f;
+  a = voice->attenuation;
+  if (a < 0.1) {
+    a = 0.1;
+  }
+  prio -= score->volume / a;
+
+  if (score->volume < 0) {
+    prio += score->volume / low;
+  } else if (bin < FLUID_STEAL_VOLUME_BINS - 1) {
+    high = fluid_steal_att_limits[bin];
+    prio += score->volume / high;
+  }
+
+  return prio;
+}
+
+/*
+ * fluid_voice_steal_insert
+ *
+ * Add a playing voice to its overflow bucket. Buckets are ordered by start
+ * time, oldest voice first. Voices are normally started in time order, so
+ * the position is searched from the tail.
+ */
+void
+fluid_voice_steal_insert(fluid_voice_t* voice)
+{
+  fluid_synth_t* synth = voice->channel->synth;
+  fluid_voice_t* prev;
+  int bucket;
+
+  fluid_voice_steal_remove(voice);
+
+  bucket = fluid_voice_get_steal_bucket(voice, &synth->overflow);
+  prev = synth->steal_tail[bucket];
+  while (prev != NULL && prev->start_time > voice->start_time)
+    prev = prev->steal_prev;
+
+  voice->steal_prev = prev;
+  if (prev != NULL) {
+    voice->steal_next = prev->steal_next;
+    prev->steal_next = voice;
+  } else {
+    voice->steal_next = synth->steal_head[bucket];
+    synth->steal_head[bucket] = voice;
+  }
+  if (voice->steal_next != NULL)
+    voice->steal_next->steal_prev = voice;
+  else
+    synth->steal_tail[bucket] = voice;
+
+  voice->steal_bucket = bucket;
+  synth->steal_count++;
+}
+
+/*
+ * fluid_voice_steal_remove
+ *
+ * Unlink a voice from its overflow bucket, if any.
+ */
+void
+fluid_voice_steal_remove(fluid_voice_t* voice)
+{
+  fluid_synth_t* synth;
+  int bucket = voice->steal_bucket;
+
+  if (bucket < 0)
+    return;
+
+  synth = voice->channel->synth;
+  if (voice->steal_prev != NULL)
+    voice->steal_prev->steal_next = voice->steal_next;
+  else
+    synth->steal_head[bucket] = voice->steal_next;
+  if (voice->steal_next != NULL)
+    voice->steal_next->steal_prev = voice->steal_prev;
+  else
+    synth->steal_tail[bucket] = voice->steal_prev;
+
+  voice->steal_prev = NULL;
+  voice->steal_next = NULL;
+  voice->steal_bucket = -1;
+  synth->steal_count--;
+}
+
+/*
+ * fluid_voice_steal_update
+ *
+ * Move a voice to another overflow bucket, if its state changed so far that
+ * it falls into one. Voices which are not in a bucket are left alone.
+ */
+void
+fluid_voice_steal_update(fluid_voice_t* voice)
+{
+  if (voice->steal_bucket < 0)
+    return;
+
+  if (fluid_voice_get_steal_bucket(voice, &voice->channel->synth->overflow)
+      != voice->steal_bucket)
+    fluid_voice_steal_insert(voice);
 }
 
 /**
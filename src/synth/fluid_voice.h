@@ -47,6 +47,13 @@ struct _fluid_overflow_prio_t
   int num_important_channels; /**< Number of elements in the important_channels array */
 };
 
+/* Playing voices are grouped into buckets of similar overflow priority, see
+ * fluid_voice_steal_update(). A bucket combines the voice state (percussion,
+ * released, sustained or on), the important channel flag and a coarse
+ * attenuation range. */
+#define FLUID_STEAL_VOLUME_BINS 7
+#define FLUID_STEAL_BUCKETS (4 * 2 * FLUID_STEAL_VOLUME_BINS)
+
 enum fluid_voice_status
 {
 	FLUID_VOICE_CLEAN,
@@ -72,11 +79,21 @@ struct _fluid_voice_t
 	fluid_gen_t gen[GEN_LAST];
 	fluid_mod_t mod[FLUID_NUM_MOD];
 	int mod_count;
+
+	/* modulator dependencies, built when the voice starts (see
+	 * fluid_voice_update_mod_deps()) */
+	int mod_dest_count;             /* number of generators that are modulated */
+	unsigned char mod_dest[FLUID_NUM_MOD];    /* the modulated generators */
+	unsigned char mod_dest_start[FLUID_NUM_MOD + 1]; /* first mod_order entry of each */
+	unsigned char mod_order[FLUID_NUM_MOD];   /* modulator indexes, grouped by generator */
+	int mod_dep_count;              /* number of entries in mod_dep */
+	unsigned short mod_dep[2 * FLUID_NUM_MOD]; /* (source << 8) | modulated generator index, sorted */
 	fluid_zone_range_t * zone_range; /* instrument zone range*/
 	fluid_sample_t* sample;         /* Pointer to sample (dupe in rvoice) */
 
 	/* basic parameters */
 	fluid_real_t output_rate;        /* the sample rate of the synthesizer (dupe in rvoice) */
+	int block_size;                  /* samples per synthesis block (dupe in rvoice) */
 
 	unsigned int start_time;
 
@@ -107,6 +124,27 @@ struct _fluid_voice_t
 	char can_access_overflow_rvoice; /* False if overflow_rvoice is being rendered in separate thread */
 	char has_noteoff; /* Flag set when noteoff has been sent */
 
+	/* list of available voices, headed by fluid_synth_t::free_voice */
+	fluid_voice_t* free_prev;
+	fluid_voice_t* free_next;
+	char is_free;                   /* TRUE while the voice is in the free list */
+	char above_polyphony;           /* TRUE if the voice is beyond synth.polyphony */
+
+	/* voice index of the channel, headed by fluid_channel_t::voices and
+	 * fluid_channel_t::key_voices[key] */
+	fluid_voice_t* chan_prev;
+	fluid_voice_t* chan_next;
+	fluid_voice_t* key_prev;
+	fluid_voice_t* key_next;
+	fluid_voice_t* excl_prev;       /* fluid_channel_t::excl_voices[excl_class & 0x7F] */
+	fluid_voice_t* excl_next;
+	int excl_class;                 /* exclusive class the voice is indexed under, 0 if none */
+
+	/* overflow bucket list, headed by fluid_synth_t::steal_head */
+	fluid_voice_t* steal_prev;
+	fluid_voice_t* steal_next;
+	int steal_bucket;               /* bucket index, -1 if not in a bucket */
+
 #ifdef WITH_PROFILING
 	/* for debugging */
 	double ref;
@@ -114,8 +152,9 @@ struct _fluid_voice_t
 };
 
 
-fluid_voice_t* new_fluid_voice(fluid_real_t output_rate);
-void delete_fluid_voice(fluid_voice_t* voice);
+void fluid_voice_setup(fluid_voice_t* voice, fluid_rvoice_t* rvoice,
+                       fluid_rvoice_t* overflow_rvoice,
+                       fluid_real_t output_rate, int block_size);
 
 void fluid_voice_start(fluid_voice_t* voice);
 void  fluid_voice_calculate_gen_pitch(fluid_voice_t* voice);
@@ -139,6 +178,9 @@ int fluid_voice_set_gain(fluid_voice_t* voice, fluid_real_t gain);
 
 int fluid_voice_set_output_rate(fluid_voice_t* voice, fluid_real_t value);
 
+/** Delay the start of the voice by a number of frames within the next block(s). */
+void fluid_voice_set_start_offset(fluid_voice_t* voice, int frames);
+
 
 /** Update all the synthesis parameters, which depend on generator
     'gen'. This is only necessary after changing a generator of an
@@ -159,6 +201,19 @@ void fluid_voice_off(fluid_voice_t* voice);
 void fluid_voice_stop(fluid_voice_t* voice);
 void fluid_voice_overflow_rvoice_finished(fluid_voice_t* voice);
 
+void fluid_voice_free_list_add(fluid_voice_t** list, fluid_voice_t* voice);
+void fluid_voice_free_list_remove(fluid_voice_t** list, fluid_voice_t* voice);
+
+void fluid_voice_channel_unlink(fluid_voice_t* voice);
+void fluid_voice_excl_unlink(fluid_voice_t* voice);
+
+void fluid_voice_steal_insert(fluid_voice_t* voice);
+void fluid_voice_steal_remove(fluid_voice_t* voice);
+void fluid_voice_steal_update(fluid_voice_t* voice);
+float fluid_voice_get_steal_prio_bound(const fluid_voice_t* voice,
+                                       const fluid_overflow_prio_t* score,
+                                       float prio);
+
 int fluid_voice_kill_excl(fluid_voice_t* voice);
 float fluid_voice_get_overflow_prio(fluid_voice_t* voice,
 					    fluid_overflow_prio_t* score,
@@ -142,6 +142,7 @@ typedef GRecMutex fluid_rec_mutex_t;
 #define fluid_rec_mutex_destroy(_m)   g_rec_mutex_clear(&(_m))
 #define fluid_rec_mutex_lock(_m)      g_rec_mutex_lock(&(_m))
 #define fluid_rec_mutex_unlock(_m)    g_rec_mutex_unlock(&(_m))
+#define fluid_rec_mutex_trylock(_m)   g_rec_mutex_trylock(&(_m))
 
 /* Dynamically allocated mutex suitable for fluid_cond_t use */
 typedef GMutex    fluid_cond_mutex_t;
@@ -217,6 +218,7 @@ typedef GStaticRecMutex fluid_rec_mutex_t;
 #define fluid_rec_mutex_destroy(_m)   g_static_rec_mutex_free(&(_m))
 #define fluid_rec_mutex_lock(_m)      g_static_rec_mutex_lock(&(_m))
 #define fluid_rec_mutex_unlock(_m)    g_static_rec_mutex_unlock(&(_m))
+#define fluid_rec_mutex_trylock(_m)   g_static_rec_mutex_trylock(&(_m))
 
 #define fluid_rec_mutex_init(_m)      do { \
   if (!g_thread_supported ()) g_thread_init (NULL); \